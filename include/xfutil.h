@@ -22,23 +22,36 @@ limitations under the License.
 #include "xfutil/block_pool.h"
 #include "xfutil/memory_pool.h"
 #include "xfutil/bloom_filter.h"
+#include "xfutil/frequency_sketch.h"
+#include "xfutil/futex.h"
 #include "xfutil/buffer.h"
 #include "xfutil/coding.h"
 #include "xfutil/directory.h"
 #include "xfutil/file.h"
+#include "xfutil/fiber.h"
 #include "xfutil/file_watcher.h"
+#include "xfutil/event_queue.h"
+#include "xfutil/event_loop.h"
 #include "xfutil/ini_file.h"
 #include "xfutil/hash.h"
 #include "xfutil/logger.h"
+#include "xfutil/lru_file_tier.h"
+#include "xfutil/lru_policy.h"
 #include "xfutil/lru_cache.h"
+#include "xfutil/clock_cache.h"
+#include "xfutil/parallel.h"
 #include "xfutil/path.h"
 #include "xfutil/process.h"
 #include "xfutil/queue.h"
+#include "xfutil/priority_queue.h"
+#include "xfutil/ring_queue.h"
 #include "xfutil/rwlock.h"
 #include "xfutil/spinlock.h"
 #include "xfutil/strutil.h"
 #include "xfutil/sysinfo.h"
 #include "xfutil/thread.h"
+#include "xfutil/thread_pool.h"
+#include "xfutil/timer_wheel.h"
 
 #if __cplusplus < 201103L
 #error "only support c++ 11 or later, use -std=c++11 option for compile"
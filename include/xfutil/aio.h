@@ -113,7 +113,8 @@ void Command::DataSync(int fd)
 //启动aio
 //io_threadnum: 不带offset的io线程数
 //pio_threadnum: 带offset的io线程数
-int Start(int io_threadnum = -1, int pio_threadnum = -2);
+//numa_spread: io线程按NUMA节点轮流绑定
+int Start(int io_threadnum = -1, int pio_threadnum = -2, bool numa_spread = false);
 
 //停止aio
 int Stop();
@@ -0,0 +1,300 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_clock_cache_h__
+#define __xfutil_clock_cache_h__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "xfutil/lru_cache.h"
+#include "xfutil/rwlock.h"
+
+namespace xfutil
+{
+
+//缓存项，命中时只置访问位，不移动链表
+template<class Key, class Value>
+struct ClockEntry : public ListNode
+{
+	static inline ClockEntry* New(const Key& k, const Value& v, size_t size, uint32_t hc)
+	{
+		return new ClockEntry(k, v, size, hc);
+	}
+	inline void Free()
+	{
+		delete this;
+	}
+
+	Key key;
+	Value value;
+	size_t value_size;
+	uint32_t hash;
+	std::atomic<bool> referenced;
+
+private:
+	ClockEntry(const Key& k, const Value& v, size_t size, uint32_t hc)
+		: key(k), value(v), value_size(size), hash(hc), referenced(false)
+	{}
+};
+
+//StrView作key：与LruEntry相同，key字节紧跟在entry之后一次分配
+template<class Value>
+struct ClockEntry<StrView, Value> : public ListNode
+{
+	static ClockEntry* New(const StrView& k, const Value& v, size_t size, uint32_t hc)
+	{
+		byte_t* buf = (byte_t*)::operator new(sizeof(ClockEntry) + k.size);
+		char* key_buf = (char*)(buf + sizeof(ClockEntry));
+		memcpy(key_buf, k.data, k.size);
+
+		ClockEntry* entry = new(buf) ClockEntry(v, size, hc);
+		entry->key.Set(key_buf, k.size);
+		return entry;
+	}
+	inline void Free()
+	{
+		this->~ClockEntry();
+		::operator delete(this);
+	}
+
+	StrView key;
+	Value value;
+	size_t value_size;
+	uint32_t hash;
+	std::atomic<bool> referenced;
+
+private:
+	ClockEntry(const Value& v, size_t size, uint32_t hc)
+		: value(v), value_size(size), hash(hc), referenced(false)
+	{}
+	~ClockEntry()
+	{}
+};
+
+/**CLOCK（second chance）淘汰：Get只持读锁并置访问位，链表只在淘汰时调整
+ * 按hash分片，每个分片有自己的读写锁和命中计数，不同分片的Get不写同一条cache line，
+ * 读多写少的场景下Get可随核数扩展；容量平均分配到各分片
+ */
+template < class Key, class Value, class Hash = LruHash<Key> >
+class ClockCache
+{
+	typedef ClockEntry<Key, Value> Entry;
+
+	//读锁和计数放在一起，命中只弄脏本分片的cache line；末尾填充避免与相邻分片共享
+	struct Shard
+	{
+		explicit Shard(size_t max) : hit_count(0), miss_count(0), max_size(max), size(0)
+		{
+			ListInit(&list);
+		}
+
+		ReadWriteLock rwlock;
+		std::atomic<size_t> hit_count;
+		std::atomic<size_t> miss_count;
+
+		LruTable<Entry> table;
+		const size_t max_size;
+		size_t size;
+		List list;
+		char pad[64];
+	};
+
+public:
+	//shard_num: 分片数，向上取整到2的幂
+	ClockCache(size_t max_size, uint32_t shard_num = 16)
+	{
+		uint32_t num = 1;
+		while(num < shard_num)
+		{
+			num <<= 1;
+		}
+		m_shard_mask = num - 1;
+
+		m_shards.reserve(num);
+		for(uint32_t i = 0; i < num; ++i)
+		{
+			m_shards.emplace_back(new Shard(max_size / num));
+		}
+	}
+	~ClockCache()
+	{
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			List* list = &m_shards[i]->list;
+			while(!ListEmtpy(list))
+			{
+				Entry* entry = static_cast<Entry*>(ListHead(list));
+				ListDelete(entry);
+				entry->Free();
+			}
+		}
+	}
+
+public:
+	void Add(const Key& key, const Value& value, size_t value_size)
+	{
+		uint32_t hash = HashOf(key);
+		Shard& shard = GetShard(hash);
+
+		WriteLockGuard lock(shard.rwlock);
+
+		//判断是否已存在，存在则不操作
+		if(shard.table.Find(key, hash) != nullptr)
+		{
+			return;
+		}
+
+		Reserve(shard, value_size);
+
+		Entry* entry = Entry::New(key, value, value_size, hash);
+		shard.table.Insert(entry);
+		ListAddHead(entry, &shard.list);
+		shard.size += value_size;
+	}
+
+	bool Get(const Key& key, Value& value)
+	{
+		uint32_t hash = HashOf(key);
+		Shard& shard = GetShard(hash);
+
+		ReadLockGuard lock(shard.rwlock);
+
+		Entry* entry = shard.table.Find(key, hash);
+		if(entry == nullptr)
+		{
+			shard.miss_count.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		value = entry->value;
+
+		//已置位时不再写，避免多核间cache line来回失效
+		if(!entry->referenced.load(std::memory_order_relaxed))
+		{
+			entry->referenced.store(true, std::memory_order_relaxed);
+		}
+		shard.hit_count.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool Delete(const Key& key)
+	{
+		uint32_t hash = HashOf(key);
+		Shard& shard = GetShard(hash);
+
+		WriteLockGuard lock(shard.rwlock);
+
+		Entry* entry = shard.table.Find(key, hash);
+		if(entry == nullptr)
+		{
+			return false;
+		}
+		Remove(shard, entry);
+		return true;
+	}
+
+	size_t Size()
+	{
+		size_t size = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			ReadLockGuard lock(m_shards[i]->rwlock);
+			size += m_shards[i]->size;
+		}
+		return size;
+	}
+
+	//各分片计数之和
+	size_t HitCount() const
+	{
+		size_t count = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			count += m_shards[i]->hit_count.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+	size_t MissCount() const
+	{
+		size_t count = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			count += m_shards[i]->miss_count.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+	inline size_t ShardNum() const
+	{
+		return m_shards.size();
+	}
+
+private:
+	inline uint32_t HashOf(const Key& key) const
+	{
+		//std::hash对整型是恒等映射，需再打散一次
+		return Hash32((uint64_t)m_hash(key));
+	}
+
+	inline Shard& GetShard(uint32_t hash)
+	{
+		return *m_shards[(hash ^ (hash >> 16)) & m_shard_mask];
+	}
+
+	static void Remove(Shard& shard, Entry* entry)
+	{
+		shard.size -= entry->value_size;
+		ListDelete(entry);
+		shard.table.Remove(entry);
+		entry->Free();
+	}
+
+	//从尾部（最旧）扫描：访问位已置则清位并移到头部，否则淘汰
+	static void Reserve(Shard& shard, size_t value_size)
+	{
+		while(!ListEmtpy(&shard.list) && shard.size + value_size > shard.max_size)
+		{
+			Entry* entry = static_cast<Entry*>(ListTail(&shard.list));
+			if(entry->referenced.load(std::memory_order_relaxed))
+			{
+				entry->referenced.store(false, std::memory_order_relaxed);
+				ListDelete(entry);
+				ListAddHead(entry, &shard.list);
+			}
+			else
+			{
+				Remove(shard, entry);
+			}
+		}
+	}
+
+private:
+	Hash m_hash;
+	uint32_t m_shard_mask;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+
+private:
+	ClockCache(const ClockCache&) = delete;
+	ClockCache& operator=(const ClockCache&) = delete;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,118 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_event_loop_h__
+#define __xfutil_event_loop_h__
+
+#include <atomic>
+#include <unordered_map>
+#include "xfutil/types.h"
+#include "xfutil/event_queue.h"
+#include "xfutil/file_watcher.h"
+#include "xfutil/timer_wheel.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#error "not support this platform"
+#endif
+
+namespace xfutil
+{
+
+//fd就绪时的回调，events为EPOLLIN/EPOLLOUT等
+typedef void (*EventHandler)(fileid_t fd, uint32_t events, void* arg);
+
+/**单线程事件循环：epoll统一等待fd、EventQueue和FileWatcher，定时器由内部的TimerWheel管理
+ * epoll_wait的超时取最近定时器的到期时间，不需要另外的定时线程
+ * Add/Remove只能在循环线程中或Run之前调用；AddTimer/CancelTimer/Stop可在任意线程调用
+ */
+class EventLoop
+{
+public:
+	EventLoop();
+	~EventLoop();
+
+public:
+	inline bool Valid() const
+	{
+		return m_epfd != INVALID_FILEID && m_wake_fd != INVALID_FILEID;
+	}
+
+	//默认水平触发，需要边缘触发时events加EPOLLET
+	bool AddFd(fileid_t fd, uint32_t events, EventHandler handler, void* arg = nullptr);
+	bool ModifyFd(fileid_t fd, uint32_t events);
+	bool RemoveFd(fileid_t fd);
+
+	//队列非空时调用handler(queue.GetID(), EPOLLIN, arg)，handler中用TryPop/PopBatch取出
+	template<typename T>
+	inline bool AddQueue(EventQueue<T>& queue, EventHandler handler, void* arg = nullptr)
+	{
+		return AddFd(queue.GetID(), EPOLLIN, handler, arg);
+	}
+
+	//有文件事件时对每个事件调用cb
+	bool AddFileWatcher(FileWatcher& watcher, FileWatcher::EventCallback cb, void* arg = nullptr);
+
+	//定时器回调在循环线程中执行，参数含义同TimerWheel::Schedule
+	uint64_t AddTimer(uint32_t delay_ms, TimerCallback cb, void* arg = nullptr, uint32_t interval_ms = 0);
+	bool CancelTimer(uint64_t timer_id);
+
+	/**等待并处理一轮事件和到期的定时器
+	 * timeout_ms: 最长等待时间，-1表示一直等到有事件或定时器到期
+	 * 返回处理的fd事件和定时器个数，-1表示错误
+	 */
+	int RunOnce(int timeout_ms = -1);
+
+	//循环直到Stop
+	void Run();
+	void Stop();
+
+	//唤醒阻塞在epoll_wait中的循环线程
+	void Wakeup();
+
+private:
+	struct Entry
+	{
+		EventHandler handler;
+		void* arg;
+		FileWatcher* watcher;
+		FileWatcher::EventCallback watch_cb;
+	};
+
+	bool Add(fileid_t fd, uint32_t events, const Entry& entry);
+
+private:
+	static const int MAX_EVENT_NUM = 64;
+
+	fileid_t m_epfd;
+	fileid_t m_wake_fd;
+	std::atomic<bool> m_stopping;
+
+	std::unordered_map<fileid_t, Entry> m_entries;
+	TimerWheel m_timers;
+
+	struct epoll_event m_events[MAX_EVENT_NUM];
+
+private:
+	EventLoop(const EventLoop&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,179 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_event_queue_h__
+#define __xfutil_event_queue_h__
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include "xfutil/types.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/eventfd.h>
+#else
+#error "not support this platform"
+#endif
+
+namespace xfutil
+{
+
+/**可被epoll等待的队列：非空时eventfd可读，由空变为非空时才写eventfd
+ * 消费者在事件循环中fd可读后用TryPop/PopBatch取出，取空时清除eventfd；没取完则保持可读
+ * 生产者在队列满时等待，与BlockingQueue相同
+ */
+template <typename T>
+class EventQueue
+{
+public:
+	explicit EventQueue(uint64_t capacity = (uint64_t)-1)
+		: m_capacity(capacity), m_signaled(false)
+	{
+		m_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+	~EventQueue()
+	{
+		if(m_efd != INVALID_FILEID)
+		{
+			close(m_efd);
+		}
+	}
+
+public:
+	inline bool Valid() const
+	{
+		return m_efd != INVALID_FILEID;
+	}
+	inline fileid_t GetID() const
+	{
+		return m_efd;
+	}
+
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_queue.size();
+	}
+
+	//只有数量限制
+	void Push(const T& v)
+	{
+		T tmp(v);
+		Push(std::move(tmp));
+	}
+	void Push(T&& v)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_queue.size() >= m_capacity)
+		{
+			m_not_full_cond.wait(lock);
+		}
+		m_queue.push_back(std::move(v));
+		Signal_();
+	}
+
+	bool TryPush(const T& v)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_queue.size() >= m_capacity)
+		{
+			return false;
+		}
+		m_queue.push_back(v);
+		Signal_();
+		return true;
+	}
+
+	bool TryPop(T& v)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_queue.empty())
+		{
+			Reset_();
+			return false;
+		}
+		v = std::move(m_queue.front());
+		m_queue.pop_front();
+		Reset_();
+		m_not_full_cond.notify_one();
+		return true;
+	}
+
+	//不等待，最多取出max_num个追加到items，返回取出的数量
+	size_t PopBatch(std::vector<T>& items, size_t max_num)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t n = MIN(max_num, m_queue.size());
+		for(size_t i = 0; i < n; ++i)
+		{
+			items.push_back(std::move(m_queue.front()));
+			m_queue.pop_front();
+		}
+		Reset_();
+		if(n > 1)
+		{
+			m_not_full_cond.notify_all();
+		}
+		else if(n == 1)
+		{
+			m_not_full_cond.notify_one();
+		}
+		return n;
+	}
+
+private:
+	//eventfd的读写都在锁内，保证eventfd可读当且仅当m_signaled为true
+	inline void Signal_()
+	{
+		if(!m_signaled)
+		{
+			m_signaled = true;
+			uint64_t value = 1;
+			ssize_t ret = write(m_efd, &value, sizeof(value));
+			(void)ret;
+		}
+	}
+
+	inline void Reset_()
+	{
+		if(m_signaled && m_queue.empty())
+		{
+			m_signaled = false;
+			uint64_t value;
+			ssize_t ret = read(m_efd, &value, sizeof(value));
+			(void)ret;
+		}
+	}
+
+private:
+	fileid_t m_efd;
+	std::mutex m_mutex;
+	std::condition_variable m_not_full_cond;
+	std::deque<T> m_queue;
+	uint64_t m_capacity;
+	bool m_signaled;
+
+private:
+	EventQueue(const EventQueue&) = delete;
+	EventQueue& operator=(const EventQueue&) = delete;
+};
+
+}
+
+#endif
+
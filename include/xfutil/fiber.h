@@ -0,0 +1,154 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_fiber_h__
+#define __xfutil_fiber_h__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "xfutil/types.h"
+#include "xfutil/aio.h"
+#include "xfutil/queue.h"
+#include "xfutil/thread.h"
+
+#ifdef __linux__
+#include <ucontext.h>
+#else
+#error "not support this platform"
+#endif
+
+namespace xfutil
+{
+
+typedef void (*FiberFunc)(void* arg);
+
+class FiberScheduler;
+
+//协程状态
+enum FiberState
+{
+	FIBER_RUNNING,
+	FIBER_YIELD,		//让出，放回运行队列
+	FIBER_SUSPENDING,	//正在挂起，尚未切回调度线程
+	FIBER_SUSPENDED,	//已挂起，等待Resume
+	FIBER_WAKEUP,		//挂起完成前已被Resume，切回调度线程后直接放回运行队列
+	FIBER_DONE,
+};
+
+struct Fiber
+{
+	ucontext_t ctx;
+	ucontext_t* sched_ctx;		//当前所在调度线程的上下文
+	byte_t* stack;				//栈映射的起始地址，最低的一页为保护页
+	std::vector<aio::Command> one_cmd;	//AwaitOne复用，不用每次分配
+	FiberFunc func;
+	void* arg;
+	FiberScheduler* sched;
+	std::atomic<int> state;
+};
+
+/**M:N协程调度器：多个协程在thread_count个线程上运行，可以在线程间迁移
+ * 每个栈单独mmap，最低一页设为不可访问，栈溢出时触发SIGSEGV而不是改写相邻协程的栈
+ * 协程阻塞在Await*上时不占用线程，aio完成回调中Resume后由任意调度线程继续执行
+ * 协程可能换线程继续执行，协程中不要持有线程相关的状态（如std::mutex跨挂起点加锁）
+ * Await*的完成回调由aio线程调用Resume：aio::Start须在使用Await*之前，aio::Stop须在调度器Stop之后
+ */
+class FiberScheduler
+{
+public:
+	FiberScheduler();
+	~FiberScheduler();
+
+public:
+	/**启动调度线程
+	 * stack_size: 每个协程的栈大小（不含保护页），需对齐到4096
+	 * cache_num: 缓存的空闲栈个数，超出的在协程结束时释放
+	 */
+	bool Start(int thread_count = 1, uint32_t stack_size = 64*1024, uint32_t cache_num = 1024);
+
+	//等待所有协程结束后停止
+	//在协程中调用时直接返回（等待自己所在的调度器会死锁），由其他线程或析构停止；不能在本调度器的协程中析构
+	void Stop();
+
+	//创建协程并放入运行队列，可在任意线程和协程中调用
+	bool Spawn(FiberFunc func, void* arg = nullptr);
+
+	inline size_t FiberNum() const
+	{
+		return m_fiber_num.load(std::memory_order_relaxed);
+	}
+
+public:
+	//当前是否在协程中
+	static bool InFiber();
+
+	//让出执行权，放到运行队列末尾
+	static void Yield();
+
+	/**提交aio并挂起当前协程，完成后各命令的ret/error写回cmds
+	 * 返回失败的命令数，提交失败或不在协程中时返回-1
+	 */
+	static int Await(std::vector<aio::Command>& cmds);
+
+	//单个读写，返回值同read/write/pread/pwrite；不在协程中时直接同步执行
+	static ssize_t AwaitRead(int fd, void* buf, size_t size);
+	static ssize_t AwaitRead(int fd, uint64_t pos, void* buf, size_t size);
+	static ssize_t AwaitWrite(int fd, const void* buf, size_t size);
+	static ssize_t AwaitWrite(int fd, uint64_t pos, const void* buf, size_t size);
+
+private:
+	//把挂起的协程放回运行队列，可在任意线程调用
+	static void Resume(Fiber* fiber);
+
+	static void FiberEntry();
+	static void Suspend(Fiber* fiber, int state);
+	static ssize_t AwaitOne(aio::Command& cmd);
+	static void AwaitCallback(const std::vector<aio::Command>& cmds, uint32_t cmd_fail_cnt, int64_t elapsed_time, void* arg);
+
+	static void ThreadFunc(int index, void* arg);
+	void Run();
+	void Free(Fiber* fiber);
+
+	byte_t* AllocStack();
+	void FreeStack(byte_t* stack);
+
+private:
+	bool m_started;
+	uint32_t m_stack_size;
+	uint32_t m_guard_size;
+	uint32_t m_stack_cache_num;
+	std::mutex m_stack_mutex;
+	std::vector<byte_t*> m_free_stacks;
+
+	BlockingQueue<Fiber*> m_run_queue;
+	ThreadGroup m_threads;
+
+	std::atomic<size_t> m_fiber_num;
+	std::mutex m_mutex;
+	std::condition_variable m_idle_cond;
+
+private:
+	FiberScheduler(const FiberScheduler&) = delete;
+	FiberScheduler& operator=(const FiberScheduler&) = delete;
+};
+
+}
+
+#endif
+
@@ -49,6 +49,15 @@ public:
 
     int Read(uint32_t timeout_ms, EventCallback cb, void* arg = nullptr);
 
+    //不等待，读完当前已有的事件；返回读取的次数，-1表示错误；用于fd可读后由事件循环调用
+    int ReadEvents(EventCallback cb, void* arg = nullptr);
+
+    //inotify的fd，可加入epoll等
+    inline fileid_t GetID() const
+    {
+        return m_ifd;
+    }
+
 private:
     void RemoveAll();
     void HandleEvent(char* buf, char* end, EventCallback cb, void* arg = nullptr);
@@ -0,0 +1,81 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_frequency_sketch_h__
+#define __xfutil_frequency_sketch_h__
+
+#include <vector>
+#include "xfutil/types.h"
+
+namespace xfutil
+{
+
+//TinyLFU频率估计：count-min sketch（4行，计数上限15）+ doorkeeper位图
+//key第一次出现只记入doorkeeper，累计增加次数达到采样数后所有计数减半、doorkeeper清空
+class FrequencySketch
+{
+public:
+	//entry_num: 预计缓存的key数量，决定sketch宽度
+	explicit FrequencySketch(size_t entry_num);
+	~FrequencySketch()
+	{}
+
+public:
+	/**记录一次访问*/
+	void Increment(uint32_t hc);
+
+	/**估计访问频率*/
+	uint32_t Estimate(uint32_t hc) const;
+
+	/**清空所有计数*/
+	void Clear();
+
+private:
+	inline size_t Index(uint32_t hc, uint32_t row) const
+	{
+		static const uint32_t seeds[ROW_NUM] = {0x9E3779B1U, 0x85EBCA77U, 0xC2B2AE3DU, 0x27D4EB2FU};
+		hc = (hc ^ (hc >> 15)) * seeds[row];
+		return row * m_width + (hc >> m_shift);
+	}
+
+	bool CheckDoorkeeper(uint32_t hc) const;
+	bool SetDoorkeeper(uint32_t hc);
+	void Reset();
+
+private:
+	static const uint32_t ROW_NUM = 4;
+	static const uint32_t DOORKEEPER_K_NUM = 3;
+	static const uint8_t MAX_COUNT = 15;
+
+	size_t m_width;
+	uint32_t m_shift;
+	std::vector<uint8_t> m_counters;
+
+	std::vector<byte_t> m_doorkeeper;
+	uint64_t m_doorkeeper_bits;
+
+	size_t m_sample_size;
+	size_t m_additions;
+
+private:
+	FrequencySketch(const FrequencySketch&) = delete;
+	FrequencySketch& operator=(const FrequencySketch&) = delete;
+};
+
+}
+
+#endif
+
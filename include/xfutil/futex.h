@@ -0,0 +1,58 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_futex_h__
+#define __xfutil_futex_h__
+
+#include <atomic>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+
+#ifdef __linux__
+//*addr等于expected时睡眠，直到被唤醒、超时或被信号打断；timeout_ms<0表示不超时
+static inline int futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, int timeout_ms)
+{
+	struct timespec ts;
+	struct timespec* pts = nullptr;
+	if(timeout_ms >= 0)
+	{
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		pts = &ts;
+	}
+	return (int)syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+}
+
+//返回唤醒的线程数
+static inline int futex_wake(std::atomic<uint32_t>* addr, int num)
+{
+	return (int)syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE_PRIVATE, num, nullptr, nullptr, 0);
+}
+
+#else
+
+#error "not support this platform"
+#endif
+
+#endif
+
@@ -27,6 +27,9 @@ uint32_t Hash32(const byte_t* data, size_t len, uint32_t seed = 4118054813);
 uint32_t Hash32(uint32_t value, uint32_t seed = 4118054813);
 uint32_t Hash32(uint64_t value, uint32_t seed = 4118054813);
 
+//CRC-32C校验，crc传入前一段数据的结果可分段计算
+uint32_t Crc32(const byte_t* data, size_t len, uint32_t crc = 0);
+
 }
 
 #endif
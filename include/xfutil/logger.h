@@ -18,6 +18,7 @@ limitations under the License.
 #define __xfutil_logger_h__
 
 #include <string>
+#include <vector>
 #include "xfutil/strutil.h"
 
 namespace xfutil 
@@ -45,6 +46,7 @@ struct LogConfig
 	uint16_t max_file_num = 4;
 	LogLevel level = LEVEL_INFO;
 	uint32_t flags = FLAG_OUT_FILENAME | FLAG_OUT_LINENUM;
+	std::vector<int> thread_cpus;	//日志线程绑定的CPU，为空时不绑定
 	
 };
 
@@ -17,195 +17,2485 @@ limitations under the License.
 #ifndef __xfutil_lru_cache_h__
 #define __xfutil_lru_cache_h__
 
+#include <cassert>
 #include <memory>
+#include <atomic>
 #include <mutex>
-#include <unordered_map>
-#include <list>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
 #include "xfutil/strutil.h"
+#include "xfutil/hash.h"
+#include "xfutil/list.h"
+#include "xfutil/frequency_sketch.h"
+#include "xfutil/time.h"
+#include "xfutil/file.h"
+#include "xfutil/coding.h"
+#include "xfutil/block_pool.h"
+#include "xfutil/pack.h"
+#include "xfutil/unpack.h"
+#include "xfutil/lru_file_tier.h"
+#include "xfutil/memory_pool.h"
+#include "xfutil/lru_policy.h"
 
-namespace xfutil 
+namespace xfutil
 {
 
-template<class Key, class Value>
-struct Node
+//挂在超时时间轮上的节点，expire_time为0表示永不超时
+struct LruExpireLink
+{
+	ListNode expire_node;
+	uint64_t expire_time;
+};
+
+//缓存项，通过继承的ListNode挂在hot/cold链表上，设置了ttl的还挂在时间轮上
+//ref: cache持有1个引用，Lookup返回的handle各持有1个，归0时释放
+//charge: 计入容量的大小，启用节点内存池时包含entry和索引的开销
+//Link: 淘汰策略的状态，见LruPolicyLinkOf
+template<class Key, class Value, class Link = LruEmptyLink>
+struct LruEntry : public ListNode, public LruExpireLink, public Link
 {
+	LruEntry(const Key& k, const Value& v, size_t size, uint32_t hc)
+		: key(k), value(v), value_size(size), charge(size), hash(hc), in_hot(false), ref(1), pool(nullptr)
+	{
+		expire_time = 0;
+	}
+
+	inline void Unref()
+	{
+		if(ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			if(pool == nullptr)
+			{
+				delete this;
+			}
+			else
+			{
+				MemoryPool* mp = pool;
+				this->~LruEntry();
+				mp->Free((byte_t*)this);
+			}
+		}
+	}
+
+	static inline LruEntry* FromExpireNode(ListNode* node)
+	{
+		return static_cast<LruEntry*>(reinterpret_cast<LruExpireLink*>(node));
+	}
+
+	//mp非空时从内存池分配
+	static LruEntry* New(const Key& k, const Value& v, size_t size, uint32_t hc, MemoryPool* mp)
+	{
+		if(mp == nullptr)
+		{
+			return new LruEntry(k, v, size, hc);
+		}
+		LruEntry* entry = new(mp->Alloc()) LruEntry(k, v, size, hc);
+		entry->pool = mp;
+		return entry;
+	}
+
+	//entry之外由key占用的字节数
+	static inline size_t KeySize(const Key& k)
+	{
+		return 0;
+	}
+
+	//Lookup返回的句柄只通过以下接口访问
+	inline const Key& GetKey() const
+	{
+		return key;
+	}
+	inline const Value& GetValue() const
+	{
+		return value;
+	}
+	inline size_t GetValueSize() const
+	{
+		return value_size;
+	}
+
 	Key key;
 	Value value;
 	size_t value_size;
+	size_t charge;
+	uint32_t hash;
+	bool in_hot;
+	std::atomic<uint32_t> ref;
+	MemoryPool* pool;		//非空时从该内存池分配
+};
+
+//StrView作key：key字节紧跟在entry之后，与entry一次分配，key指向这段内存
+//长度不定，不从节点内存池分配
+template<class Value, class Link>
+struct LruEntry<StrView, Value, Link> : public ListNode, public LruExpireLink, public Link
+{
+	inline void Unref()
+	{
+		if(ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			this->~LruEntry();
+			::operator delete(this);
+		}
+	}
+
+	static inline LruEntry* FromExpireNode(ListNode* node)
+	{
+		return static_cast<LruEntry*>(reinterpret_cast<LruExpireLink*>(node));
+	}
+
+	static LruEntry* New(const StrView& k, const Value& v, size_t size, uint32_t hc, MemoryPool* mp)
+	{
+		byte_t* buf = (byte_t*)::operator new(sizeof(LruEntry) + k.size);
+		char* key_buf = (char*)(buf + sizeof(LruEntry));
+		memcpy(key_buf, k.data, k.size);
+
+		LruEntry* entry = new(buf) LruEntry(v, size, hc);
+		entry->key.Set(key_buf, k.size);
+		return entry;
+	}
+
+	static inline size_t KeySize(const StrView& k)
+	{
+		return k.size;
+	}
+
+	inline const StrView& GetKey() const
+	{
+		return key;
+	}
+	inline const Value& GetValue() const
+	{
+		return value;
+	}
+	inline size_t GetValueSize() const
+	{
+		return value_size;
+	}
+
+	StrView key;
+	Value value;
+	size_t value_size;
+	size_t charge;
+	uint32_t hash;
+	bool in_hot;
+	std::atomic<uint32_t> ref;
+
+private:
+	LruEntry(const Value& v, size_t size, uint32_t hc)
+		: value(v), value_size(size), charge(size), hash(hc), in_hot(false), ref(1)
+	{
+		expire_time = 0;
+	}
+	~LruEntry()
+	{
+	}
+};
+
+//默认hash：StrView按key字节计算，其他类型用std::hash
+template<class Key>
+struct LruHash : public std::hash<Key>
+{
+};
+
+template<>
+struct LruHash<StrView>
+{
+	inline size_t operator()(const StrView& key) const
+	{
+		return Hash32((const byte_t*)key.data, key.size);
+	}
+};
+
+//开放寻址（线性探测）索引，只存放entry指针和hash值，查找/删除不分配内存
+template<class Entry>
+class LruTable
+{
+public:
+	struct Slot
+	{
+		Entry* entry;
+		uint32_t hash;
+	};
+
+public:
+	LruTable()
+	{
+		m_slots = nullptr;
+		m_mask = 0;
+		m_shift = 32;
+		m_count = 0;
+		Resize(16);
+	}
+	~LruTable()
+	{
+		delete[] m_slots;
+	}
+
+public:
+	template<class K>
+	Entry* Find(const K& key, uint32_t hash) const
+	{
+		for(size_t i = Index(hash); ; i = (i + 1) & m_mask)
+		{
+			const Slot& slot = m_slots[i];
+			if(slot.entry == nullptr)
+			{
+				return nullptr;
+			}
+			if(slot.hash == hash && slot.entry->key == key)
+			{
+				return slot.entry;
+			}
+		}
+	}
+
+	//调用者保证entry不存在
+	void Insert(Entry* entry)
+	{
+		if((m_count + 1) * 4 > (m_mask + 1) * 3)
+		{
+			Resize((m_mask + 1) * 2);
+		}
+		Put(entry);
+		++m_count;
+	}
+
+	void Remove(Entry* entry)
+	{
+		size_t i = Index(entry->hash);
+		while(m_slots[i].entry != entry)
+		{
+			assert(m_slots[i].entry != nullptr);
+			i = (i + 1) & m_mask;
+		}
+
+		//后移删除：把后续可前移的slot补到空位上，避免墓碑
+		for(size_t j = i; ; )
+		{
+			j = (j + 1) & m_mask;
+			if(m_slots[j].entry == nullptr)
+			{
+				break;
+			}
+			size_t k = Index(m_slots[j].hash);
+			bool stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+			if(!stay)
+			{
+				m_slots[i] = m_slots[j];
+				i = j;
+			}
+		}
+		m_slots[i].entry = nullptr;
+		--m_count;
+	}
+
+	inline size_t Count() const
+	{
+		return m_count;
+	}
+
+	//预取hash对应的首个slot，批量查找时先全部预取再逐个探测
+	inline void Prefetch(uint32_t hash) const
+	{
+		__builtin_prefetch(&m_slots[Index(hash)]);
+	}
+
+private:
+	inline size_t Index(uint32_t hash) const
+	{
+		return (uint32_t)(hash * 2654435769U) >> m_shift;
+	}
+
+	void Put(Entry* entry)
+	{
+		size_t i = Index(entry->hash);
+		while(m_slots[i].entry != nullptr)
+		{
+			i = (i + 1) & m_mask;
+		}
+		m_slots[i].entry = entry;
+		m_slots[i].hash = entry->hash;
+	}
+
+	void Resize(size_t capacity)
+	{
+		Slot* old_slots = m_slots;
+		size_t old_capacity = (old_slots != nullptr) ? m_mask + 1 : 0;
+
+		m_slots = new Slot[capacity]();
+		m_mask = capacity - 1;
+		m_shift = 32;
+		for(size_t c = capacity; c > 1; c >>= 1)
+		{
+			--m_shift;
+		}
+
+		for(size_t i = 0; i < old_capacity; ++i)
+		{
+			if(old_slots[i].entry != nullptr)
+			{
+				Put(old_slots[i].entry);
+			}
+		}
+		delete[] old_slots;
+	}
+
+private:
+	Slot* m_slots;
+	size_t m_mask;
+	uint32_t m_shift;
+	size_t m_count;
+
+private:
+	LruTable(const LruTable&) = delete;
+	LruTable& operator=(const LruTable&) = delete;
+};
+
+//正在加载的key，同一key的并发未命中只由一个调用者执行loader，其余等待结果
+template<class Key, class Value>
+struct LruLoadCall
+{
+	LruLoadCall(const Key& k, uint32_t hc)
+		: key(k), hash(hc), ref(1), done(false), ok(false), stale(false)
+	{}
+
+	Key key;
+	uint32_t hash;
+	uint32_t ref;		//由cache的锁保护
+	bool done;
+	bool ok;
+	bool stale;			//加载期间key被Delete或插入了新值，结果不再放入cache
+	Value value;
+	std::condition_variable cond;
+};
+
+//从持久化文件读出的entry
+template<class Key, class Value>
+struct LruLoadItem
+{
+	Key key;
+	Value value;
+	uint64_t value_size;
+	uint32_t ttl_ms;
+	uint8_t in_hot;
+};
+
+//Policy: 淘汰策略，见lru_policy.h，默认为分段LRU
+template < class Key, class Value, class Hash = LruHash<Key>, template<class> class Policy = LruSegmentPolicy >
+class LruCache
+{
+	typedef LruEntry<Key, Value, typename LruPolicyLinkOf<Policy>::Type> Entry;
+	typedef LruLoadCall<Key, Value> LoadCall;
+
+	template<class K, class V, class H, template<class> class P> friend class ShardedLruCache;
+
+public:
+	//admission_entry_num: 非0时启用TinyLFU准入，按预计的key数量分配频率sketch
+	LruCache(size_t max_size, size_t admission_entry_num = 0)
+		: m_policy(max_size)
+	{
+		if(admission_entry_num != 0)
+		{
+			m_sketch.reset(new FrequencySketch(admission_entry_num));
+		}
+
+		m_node_overhead = 0;
+		m_ttl_num = 0;
+		m_expire_tick = 0;
+		m_expire_far_tick = 0;
+		ListInit(&m_expire_far);
+		m_handle_num = 0;
+	}
+	~LruCache()
+	{
+		assert(m_handle_num.load(std::memory_order_relaxed) == 0);
+		for(size_t i = 0; i < m_tier_ops.size(); ++i)
+		{
+			m_tier_ops[i].entry->Unref();
+		}
+		m_policy.Foreach([](Entry* entry) {
+			entry->Unref();
+		});
+	}
+
+	//未命中时加载数据，返回false表示加载失败
+	typedef std::function<bool(const Key& key, Value& value, size_t& value_size)> Loader;
+	//批量加载，keys为去重后的未命中key，结果按下标写入values/value_sizes/loaded（均已按keys.size()分配）
+	typedef std::function<void(const std::vector<Key>& keys, std::vector<Value>& values, 
+						std::vector<size_t>& value_sizes, std::vector<bool>& loaded)> BatchLoader;
+
+	//Lookup返回的句柄，通过GetKey/GetValue访问数据，用完必须Release
+	typedef Entry Handle;
+
+	//SaveTo/LoadFrom时key和value的序列化方法，由调用者提供
+	typedef std::function<void(Packer& packer, const Key& key, const Value& value)> EntryPacker;
+	typedef std::function<bool(Unpacker& unpacker, Key& key, Value& value)> EntryUnpacker;
+
+	typedef LruLoadItem<Key, Value> LoadItem;
+	//每读出一个chunk回调一次，只有前item_num个有效
+	typedef std::function<void(const std::vector<LoadItem>& items, size_t item_num)> LoadHandler;
+
+public:
+	//ttl_ms: 有效期，0表示永不超时；超时的entry在Get时视为未命中
+	void Add(const Key& key, const Value& value, size_t value_size, uint32_t ttl_ms = 0)
+	{
+		Add(key, HashOf(key), value, value_size, ttl_ms);
+	}
+
+	bool Get(const Key& key, Value& value)
+	{
+		return Get(key, HashOf(key), value);
+	}
+
+	bool Delete(const Key& key)
+	{
+		return Delete(key, HashOf(key));
+	}
+
+	//返回entry的句柄而不复制value，未命中返回nullptr；只查内存，不读文件二级缓存
+	//被淘汰或删除的entry在所有句柄Release后才释放
+	const Handle* Lookup(const Key& key)
+	{
+		return Lookup(key, HashOf(key));
+	}
+
+	//不需要加锁；必须在cache析构前调用，启用EnableNodePool时entry归还给cache自有的内存池
+	void Release(const Handle* handle)
+	{
+		m_handle_num.fetch_sub(1, std::memory_order_relaxed);
+		const_cast<Handle*>(handle)->Unref();
+	}
+
+	//未命中时调用loader加载并Add，同一key的并发调用只执行一次loader
+	bool GetOrLoad(const Key& key, Value& value, const Loader& loader, uint32_t ttl_ms = 0)
+	{
+		return GetOrLoad(key, HashOf(key), value, loader, ttl_ms);
+	}
+
+	//批量查找，整批只加锁一次，found[i]表示keys[i]是否命中
+	void MultiGet(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found)
+	{
+		std::vector<uint32_t> hashs;
+		std::vector<size_t> indexs;
+		PrepareBatch(keys, hashs, indexs);
+
+		values.resize(keys.size());
+		found.assign(keys.size(), false);
+		MultiGet(keys, hashs, indexs.data(), indexs.size(), values, found);
+	}
+
+	//批量添加，整批只加锁一次，value_sizes与keys一一对应
+	void MultiAdd(const std::vector<Key>& keys, const std::vector<Value>& values, 
+				const std::vector<size_t>& value_sizes, uint32_t ttl_ms = 0)
+	{
+		std::vector<uint32_t> hashs;
+		std::vector<size_t> indexs;
+		PrepareBatch(keys, hashs, indexs);
+
+		MultiAdd(keys, hashs, indexs.data(), indexs.size(), values, value_sizes, ttl_ms);
+	}
+
+	//批量版本：所有未命中且没有其他线程在加载的key合并为一次loader调用
+	//found[i]表示keys[i]是否取到值
+	void MultiGetOrLoad(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found,
+						const BatchLoader& loader, uint32_t ttl_ms = 0);
+
+	//按淘汰策略的保留优先级（分段LRU为hot、cold各自从新到旧）保存到文件，先写临时文件再改名
+	//持锁只对entry加引用做快照，序列化和写文件在锁外进行；单个entry序列化后超过FILE_MAX_CHUNK_SIZE时保存失败
+	bool SaveTo(const char* path, const EntryPacker& packer);
+
+	/**按文件顺序装入，容量不足时丢弃后面（较冷）的entry，已超时的entry跳过
+	 * 只读一遍文件：先检查头部和尾部，再按chunk流式读取并装入，每个chunk加锁一次
+	 * 读到损坏的chunk或整个文件的校验和、计数与尾部不符时，删除本次已装入的entry，返回false
+	 */
+	bool LoadFrom(const char* path, const EntryUnpacker& unpacker)
+	{
+		std::vector<Entry*> loaded;
+		bool ok = ReadFile(path, unpacker, [this, &loaded](const std::vector<LoadItem>& items, size_t item_num) {
+			std::vector<uint32_t> hashs(item_num);
+			std::vector<size_t> indexs(item_num);
+			for(size_t i = 0; i < item_num; ++i)
+			{
+				hashs[i] = HashOf(items[i].key);
+				indexs[i] = i;
+			}
+			LoadItems(items, hashs, indexs.data(), item_num, loaded);
+		});
+		FinishLoadItems(loaded, !ok);
+		return ok;
+	}
+
+	//解析SaveTo写的文件，已超时的entry被跳过；handler为空时只校验
+	//头部或尾部不对时不调用handler；chunk损坏或整个文件与尾部不符时返回false，此前的chunk已交给handler
+	static bool ReadFile(const char* path, const EntryUnpacker& unpacker, const LoadHandler& handler);
+
+	//只检查头部和尾部（文件是否完整写完），不读数据
+	static bool CheckFile(const char* path);
+
+	/**启用文件二级缓存：淘汰的entry追加写入dir下的段文件，Get/MultiGet/GetOrLoad/MultiGetOrLoad在内存未命中时从文件读回
+	 * 持锁时只把写入和删除排队，解锁后由当时的调用者按入队顺序执行，文件IO和段回收都不持有cache的锁
+	 * 必须在使用cache前调用；packer/unpacker与SaveTo/LoadFrom相同
+	 */
+	bool EnableFileTier(const char* dir, uint64_t max_file_size, const EntryPacker& packer, 
+						const EntryUnpacker& unpacker, uint32_t segment_size = 16*1024*1024)
+	{
+		std::unique_ptr<BlockPool> pool(new BlockPool());
+		std::unique_ptr<LruFileTier> tier(new LruFileTier());
+		if(!pool->Init(FILE_BLOCK_SIZE, 1) || !tier->Open(dir, max_file_size, segment_size))
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tier_pool.swap(pool);
+		m_tier.swap(tier);
+		m_tier_packer = packer;
+		m_tier_unpacker = unpacker;
+		return true;
+	}
+
+	//entry节点改从cache自有的内存池分配，空闲的块整块归还；
+	//同时容量按value_size加entry节点和索引slot的实际开销计算（StrView作key时entry不从内存池分配，只计入开销）
+	//必须在Add前调用，启用后所有handle须在cache析构前Release
+	bool EnableNodePool(uint32_t block_size = 64*1024, uint32_t cache_num = 0)
+	{
+		std::unique_ptr<BlockPool> block_pool(new BlockPool());
+		if(!block_pool->Init(block_size, 0))
+		{
+			return false;
+		}
+		std::unique_ptr<MemoryPool> node_pool(new MemoryPool(*block_pool));
+		if(!node_pool->Init(sizeof(Entry), cache_num))
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_table.Count() != 0)
+		{
+			return false;
+		}
+		m_node_block_pool.swap(block_pool);
+		m_node_pool.swap(node_pool);
+		//装载率不超过3/4，每个entry平均占用4/3个slot
+		m_node_overhead = sizeof(Entry) + sizeof(typename LruTable<Entry>::Slot) * 4 / 3;
+		return true;
+	}
+
+	//回收已超时的entry，Add时也会自动执行
+	void Expire()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ExpireEntries();
+	}
+
+	//以下统计接口不加锁，各项之间不保证一致
+	inline size_t Size() const
+	{
+		return m_policy.Size();
+	}
+
+	inline size_t HitCount() const
+	{
+		return m_hit_count;
+	}
+
+	inline size_t MissCount() const
+	{
+		return m_miss_count;
+	}
+
+	LruCacheStats Stats() const
+	{
+		LruCacheStats stats;
+		stats.hit_count = m_hit_count;
+		stats.miss_count = m_miss_count;
+		stats.insert_count = m_insert_count;
+		stats.evict_count = m_evict_count;
+		stats.expire_count = m_expire_count;
+		stats.reject_count = m_reject_count;
+		stats.spill_count = m_spill_count;
+		stats.tier_hit_count = m_tier_hit_count;
+		m_policy.Stats(stats);
+		return stats;
+	}
+
+private:
+	//排队的文件二级缓存操作
+	struct TierOp
+	{
+		Entry* entry;		//持有引用
+		bool spill;			//true为写入entry，false为删除文件中entry->key的所有记录
+	};
+
+	//锁外读文件二级缓存期间登记在m_tier_reads中，同一key被Delete或插入新值时置stale，读到的值不再放回内存
+	class TierRead
+	{
+	public:
+		TierRead(LruCache& cache, const Key& k, uint32_t hc)
+			: key(k), hash(hc), stale(false), m_cache(cache), m_registered(false)
+		{}
+		~TierRead()
+		{
+			if(m_registered)
+			{
+				std::lock_guard<std::mutex> lock(m_cache.m_mutex);
+				Unregister();
+			}
+		}
+
+		//以下持锁调用
+		void Register()
+		{
+			m_cache.m_tier_reads.push_back(this);
+			m_registered = true;
+		}
+		void Unregister()
+		{
+			std::vector<TierRead*>& reads = m_cache.m_tier_reads;
+			reads.erase(std::find(reads.begin(), reads.end(), this));
+			m_registered = false;
+		}
+
+		const Key& key;
+		uint32_t hash;
+		bool stale;
+
+	private:
+		LruCache& m_cache;
+		bool m_registered;
+	};
+
+	inline uint32_t HashOf(const Key& key) const
+	{
+		//std::hash对整型是恒等映射，需再打散一次
+		return Hash32((uint64_t)m_hash(key));
+	}
+
+	void Add(const Key& key, uint32_t hash, const Value& value, size_t value_size, uint32_t ttl_ms)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Add_(key, hash, value, value_size, ttl_ms);
+		}
+		DrainTier();
+	}
+
+	void PrepareBatch(const std::vector<Key>& keys, std::vector<uint32_t>& hashs, std::vector<size_t>& indexs) const
+	{
+		hashs.resize(keys.size());
+		indexs.resize(keys.size());
+		for(size_t i = 0; i < keys.size(); ++i)
+		{
+			hashs[i] = HashOf(keys[i]);
+			indexs[i] = i;
+		}
+	}
+
+	//只处理indexs指定的下标，内存未命中的再逐个读文件二级缓存
+	void MultiGet(const std::vector<Key>& keys, const std::vector<uint32_t>& hashs, const size_t* indexs, size_t num,
+				std::vector<Value>& values, std::vector<bool>& found)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(size_t i = 0; i < num; ++i)
+			{
+				m_table.Prefetch(hashs[indexs[i]]);
+			}
+			for(size_t i = 0; i < num; ++i)
+			{
+				size_t idx = indexs[i];
+				found[idx] = Get_(keys[idx], hashs[idx], values[idx]);
+			}
+		}
+		if(m_tier)
+		{
+			for(size_t i = 0; i < num; ++i)
+			{
+				size_t idx = indexs[i];
+				if(!found[idx])
+				{
+					found[idx] = GetTier(keys[idx], hashs[idx], values[idx]);
+				}
+			}
+		}
+		DrainTier();
+	}
+
+	void MultiAdd(const std::vector<Key>& keys, const std::vector<uint32_t>& hashs, const size_t* indexs, size_t num,
+				const std::vector<Value>& values, const std::vector<size_t>& value_sizes, uint32_t ttl_ms)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(size_t i = 0; i < num; ++i)
+			{
+				m_table.Prefetch(hashs[indexs[i]]);
+			}
+			for(size_t i = 0; i < num; ++i)
+			{
+				size_t idx = indexs[i];
+				Add_(keys[idx], hashs[idx], values[idx], value_sizes[idx], ttl_ms);
+			}
+		}
+		DrainTier();
+	}
+
+	bool Get(const Key& key, uint32_t hash, Value& value)
+	{
+		bool hit;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			hit = Get_(key, hash, value);
+		}
+		if(!hit && m_tier)
+		{
+			hit = GetTier(key, hash, value);
+		}
+		DrainTier();
+		return hit;
+	}
+
+	const Handle* Lookup(const Key& key, uint32_t hash)
+	{
+		Entry* entry;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			entry = Find_(key, hash);
+			if(entry != nullptr)
+			{
+				entry->ref.fetch_add(1, std::memory_order_relaxed);
+				m_handle_num.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		DrainTier();
+		return entry;
+	}
+
+	bool GetOrLoad(const Key& key, uint32_t hash, Value& value, const Loader& loader, uint32_t ttl_ms)
+	{
+		bool ok = GetOrLoad_(key, hash, value, loader, ttl_ms);
+		DrainTier();
+		return ok;
+	}
+
+	bool GetOrLoad_(const Key& key, uint32_t hash, Value& value, const Loader& loader, uint32_t ttl_ms)
+	{
+		LoadBatch batch(*this);
+		size_t value_size = 0;
+		uint32_t tier_ttl_ms = 0;
+		bool tier_hit = false;
+		bool read_tier = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if(Get_(key, hash, value))
+			{
+				return true;
+			}
+
+			LoadCall* call = m_load_table.Find(key, hash);
+			if(call != nullptr)
+			{
+				++call->ref;
+				return WaitLoad(lock, call, value);
+			}
+
+			call = new LoadCall(key, hash);
+			m_load_table.Insert(call);
+			batch.calls.push_back(call);
+
+			read_tier = m_tier && CheckTierOps(key, hash, value, value_size, tier_ttl_ms, tier_hit);
+		}
+
+		if(read_tier)
+		{
+			tier_hit = ReadTier(key, hash, value, value_size, tier_ttl_ms);
+		}
+		bool ok = tier_hit || loader(key, value, value_size);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(tier_hit)
+		{
+			++m_tier_hit_count;
+			ttl_ms = tier_ttl_ms;
+		}
+		LoadCall* call = batch.calls[0];
+		batch.calls.clear();
+		FinishLoad(call, ok, value, value_size, ttl_ms, tier_hit);
+		ReleaseLoad(call);
+		return ok;
+	}
+
+	/**本线程负责加载的call（calls，与keys/indexs一一对应）和等待其他调用者加载的call（waits）
+	 * 正常流程中处理完即从中移除；loader抛出异常时由析构函数把未完成的call标记为失败、唤醒等待者并释放引用
+	 * 析构时会加cache的锁，调用者此时不能持锁
+	 */
+	class LoadBatch
+	{
+	public:
+		explicit LoadBatch(LruCache& cache) : m_cache(cache)
+		{}
+		~LoadBatch()
+		{
+			if(calls.empty() && waits.empty())
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(m_cache.m_mutex);
+			for(size_t i = 0; i < calls.size(); ++i)
+			{
+				if(calls[i] != nullptr)
+				{
+					if(!calls[i]->done)
+					{
+						m_cache.FinishLoad(calls[i], false, calls[i]->value, 0, 0);
+					}
+					m_cache.ReleaseLoad(calls[i]);
+				}
+			}
+			for(size_t i = 0; i < waits.size(); ++i)
+			{
+				m_cache.ReleaseLoad(waits[i].second);
+			}
+		}
+
+		std::vector<Key> keys;
+		std::vector<size_t> indexs;
+		std::vector<LoadCall*> calls;
+		std::vector<std::pair<size_t, LoadCall*>> waits;	//下标->等待的call
+
+	private:
+		LruCache& m_cache;
+	};
+
+	//批量加载第一步：取出命中的key，为未命中且没有其他调用者在加载的key登记call，只处理indexs指定的下标
+	void BeginLoad(const std::vector<Key>& keys, const std::vector<uint32_t>& hashs, const size_t* indexs, size_t num,
+				std::vector<Value>& values, std::vector<bool>& found, LoadBatch& batch)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(size_t i = 0; i < num; ++i)
+		{
+			size_t idx = indexs[i];
+			if(Get_(keys[idx], hashs[idx], values[idx]))
+			{
+				found[idx] = true;
+				continue;
+			}
+
+			//已有加载（包括本批次中重复的key）则等待
+			LoadCall* call = m_load_table.Find(keys[idx], hashs[idx]);
+			if(call != nullptr)
+			{
+				++call->ref;
+				batch.waits.push_back(std::make_pair(idx, call));
+				continue;
+			}
+
+			call = new LoadCall(keys[idx], hashs[idx]);
+			m_load_table.Insert(call);
+			batch.keys.push_back(keys[idx]);
+			batch.indexs.push_back(idx);
+			batch.calls.push_back(call);
+		}
+	}
+
+	//第二步：先读文件二级缓存，命中的key直接完成，剩下的留给loader
+	void LoadTier(LoadBatch& batch, std::vector<Value>& values, std::vector<bool>& found)
+	{
+		if(!m_tier || batch.calls.empty())
+		{
+			return;
+		}
+
+		size_t num = batch.calls.size();
+		std::vector<Value> tier_values(num);
+		std::vector<size_t> value_sizes(num, 0);
+		std::vector<uint32_t> ttls(num, 0);
+		std::vector<bool> hits(num, false);
+		std::vector<bool> reads(num, false);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(size_t i = 0; i < num; ++i)
+			{
+				bool hit = false;
+				reads[i] = CheckTierOps(batch.keys[i], batch.calls[i]->hash, tier_values[i], value_sizes[i], ttls[i], hit);
+				hits[i] = hit;
+			}
+		}
+		for(size_t i = 0; i < num; ++i)
+		{
+			if(reads[i])
+			{
+				hits[i] = ReadTier(batch.keys[i], batch.calls[i]->hash, tier_values[i], value_sizes[i], ttls[i]);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(size_t i = 0; i < num; ++i)
+		{
+			if(hits[i])
+			{
+				LoadCall* call = batch.calls[i];
+				batch.calls[i] = nullptr;
+
+				++m_tier_hit_count;
+				FinishLoad(call, true, tier_values[i], value_sizes[i], ttls[i], true);
+				ReleaseLoad(call);
+				values[batch.indexs[i]] = std::move(tier_values[i]);
+				found[batch.indexs[i]] = true;
+			}
+		}
+
+		size_t keep = 0;
+		for(size_t i = 0; i < num; ++i)
+		{
+			if(batch.calls[i] != nullptr)
+			{
+				if(keep != i)
+				{
+					batch.keys[keep] = std::move(batch.keys[i]);
+					batch.indexs[keep] = batch.indexs[i];
+					batch.calls[keep] = batch.calls[i];
+				}
+				++keep;
+			}
+		}
+		batch.keys.resize(keep);
+		batch.indexs.resize(keep);
+		batch.calls.resize(keep);
+	}
+
+	//第三步：loader返回后写入结果并唤醒等待者，batch的第i个key对应load_values等的第offset+i个
+	void EndLoad(LoadBatch& batch, size_t offset, std::vector<Value>& load_values, const std::vector<size_t>& value_sizes,
+				const std::vector<bool>& loaded, std::vector<Value>& values, std::vector<bool>& found, uint32_t ttl_ms)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(size_t i = 0; i < batch.calls.size(); ++i)
+		{
+			LoadCall* call = batch.calls[i];
+			batch.calls[i] = nullptr;
+
+			size_t j = offset + i;
+			FinishLoad(call, loaded[j], load_values[j], value_sizes[j], ttl_ms);
+			ReleaseLoad(call);
+
+			if(loaded[j])
+			{
+				values[batch.indexs[i]] = std::move(load_values[j]);
+				found[batch.indexs[i]] = true;
+			}
+		}
+		batch.calls.clear();
+	}
+
+	//第四步：等待其他调用者的加载，所有分片的EndLoad完成后才能调用，否则可能互相等待
+	void WaitLoads(LoadBatch& batch, std::vector<Value>& values, std::vector<bool>& found)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while(!batch.waits.empty())
+			{
+				std::pair<size_t, LoadCall*> wait = batch.waits.back();
+				batch.waits.pop_back();
+				found[wait.first] = WaitLoad(lock, wait.second, values[wait.first]);
+			}
+		}
+		DrainTier();
+	}
+
+	//等待其他调用者加载完成，调用前已增加call的引用
+	bool WaitLoad(std::unique_lock<std::mutex>& lock, LoadCall* call, Value& value)
+	{
+		while(!call->done)
+		{
+			call->cond.wait(lock);
+		}
+		bool ok = call->ok;
+		if(ok)
+		{
+			value = call->value;
+		}
+		ReleaseLoad(call);
+		return ok;
+	}
+
+	//先标记完成再Add，Add或复制value抛出异常时call的状态仍然完整；stale时只把结果交给等待者
+	void FinishLoad(LoadCall* call, bool ok, const Value& value, size_t value_size, uint32_t ttl_ms, bool from_tier = false)
+	{
+		m_load_table.Remove(call);
+		call->done = true;
+		call->ok = false;
+		//等待者在解锁后才会被唤醒
+		call->cond.notify_all();
+		if(ok)
+		{
+			//有等待者时才需要保存结果
+			if(call->ref > 1)
+			{
+				call->value = value;
+			}
+			call->ok = true;
+			if(!call->stale)
+			{
+				Add_(call->key, call->hash, value, value_size, ttl_ms, from_tier);
+			}
+		}
+	}
+
+	inline void ReleaseLoad(LoadCall* call)
+	{
+		if(--call->ref == 0)
+		{
+			delete call;
+		}
+	}
+
+	bool WriteChunk(File& file, BlockBufferPtr& buf, uint32_t entry_num, uint32_t& file_crc);
+
+	//文件尾部：magic+chunk数+entry数+尾部之前整个文件的crc+尾部自身的crc
+	struct FileTrailer
+	{
+		uint32_t chunk_num;
+		uint64_t entry_num;
+		uint32_t file_crc;
+	};
+	static bool OpenFile(File& file, const char* path, FileTrailer& trailer, int64_t& data_end);
+
+	//装入的entry加引用后记入loaded，装入失败时用于回滚
+	void LoadItems(const std::vector<LoadItem>& items, const std::vector<uint32_t>& hashs, const size_t* indexs, size_t num,
+					std::vector<Entry*>& loaded)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(size_t i = 0; i < num; ++i)
+		{
+			const LoadItem& item = items[indexs[i]];
+			Entry* entry = Load_(item.key, hashs[indexs[i]], item.value, item.value_size, item.in_hot != 0, item.ttl_ms);
+			if(entry != nullptr)
+			{
+				entry->ref.fetch_add(1, std::memory_order_relaxed);
+				loaded.push_back(entry);
+			}
+		}
+	}
+
+	//rollback为true时删除loaded中仍在cache里的entry（期间已被淘汰或替换的不动），最后释放装入时加的引用
+	void FinishLoadItems(const std::vector<Entry*>& loaded, bool rollback)
+	{
+		if(rollback)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for(size_t i = 0; i < loaded.size(); ++i)
+			{
+				if(m_table.Find(loaded[i]->key, loaded[i]->hash) == loaded[i])
+				{
+					Remove(loaded[i]);
+				}
+			}
+		}
+		for(size_t i = 0; i < loaded.size(); ++i)
+		{
+			loaded[i]->Unref();
+		}
+	}
+
+	//启用节点内存池时计入entry、key和索引的开销
+	inline size_t ChargeOf(const Key& key, size_t value_size) const
+	{
+		return m_node_pool ? value_size + m_node_overhead + Entry::KeySize(key) : value_size;
+	}
+
+	Entry* NewEntry(const Key& key, const Value& value, size_t value_size, uint32_t hash)
+	{
+		Entry* entry = Entry::New(key, value, value_size, hash, m_node_pool.get());
+		entry->charge = ChargeOf(key, value_size);
+		return entry;
+	}
+
+	//装入时按原来的位置直接追加，不触发淘汰；返回新插入的entry，已存在或放不下时返回nullptr
+	Entry* Load_(const Key& key, uint32_t hash, const Value& value, size_t value_size, bool in_hot, uint32_t ttl_ms)
+	{
+		if(FindUnexpired(key, hash) != nullptr)
+		{
+			return nullptr;
+		}
+
+		size_t charge = ChargeOf(key, value_size);
+		if(!m_policy.Fits(charge, in_hot))
+		{
+			return nullptr;
+		}
+
+		Entry* entry = NewEntry(key, value, value_size, hash);
+		entry->in_hot = in_hot;
+		m_table.Insert(entry);
+		m_policy.Load(entry);
+		++m_insert_count;
+
+		if(ttl_ms != 0)
+		{
+			AddExpire(entry, GetTickMilliTime() + ttl_ms);
+		}
+		return entry;
+	}
+
+	//from_tier: value从文件二级缓存读回，被拒绝准入时文件中的记录保持不变
+	void Add_(const Key& key, uint32_t hash, const Value& value, size_t value_size, uint32_t ttl_ms, bool from_tier = false)
+	{
+		ExpireEntries();
+
+		//判断是否已存在，存在则不操作；已超时但还没被扫到的旧值先删除，再插入新值
+		if(FindUnexpired(key, hash) != nullptr)
+		{
+			return;
+		}
+		Invalidate(key, hash);
+
+		size_t charge = ChargeOf(key, value_size);
+		if(m_sketch)
+		{
+			m_sketch->Increment(hash);
+			if(!Admit(hash, charge))
+			{
+				++m_reject_count;
+				//新值没有进入内存，用它替换文件中的旧值
+				if(m_tier && !from_tier && HasTierCopy(key, hash))
+				{
+					Entry* entry = NewEntry(key, value, value_size, hash);
+					entry->expire_time = (ttl_ms != 0) ? GetTickMilliTime() + ttl_ms : 0;
+					QueueTierOp(entry, false);
+					QueueTierOp(entry, true);
+					entry->Unref();
+				}
+				return;
+			}
+		}
+
+		//准入后才应用ARC的ghost命中，被拒绝的key不影响target
+		m_policy.BeforeInsert(hash);
+		Reserve(charge);
+
+		Entry* entry = NewEntry(key, value, value_size, hash);
+		m_table.Insert(entry);
+		m_policy.Insert(entry);
+		++m_insert_count;
+
+		if(ttl_ms != 0)
+		{
+			AddExpire(entry, GetTickMilliTime() + ttl_ms);
+		}
+
+		//准入后才删除文件中的旧值
+		if(m_tier && HasTierCopy(key, hash))
+		{
+			QueueTierOp(entry, false);
+		}
+	}
+
+	bool Get_(const Key& key, uint32_t hash, Value& value)
+	{
+		Entry* entry = Find_(key, hash);
+		if(entry == nullptr)
+		{
+			return false;
+		}
+		value = entry->value;
+		return true;
+	}
+
+	/**查找未超时的entry
+	 * ExpireEntries只按整个tick（EXPIRE_TICK_MS）清理，当前tick内已超时的entry仍在表中，这里遇到时删除
+	 */
+	Entry* FindUnexpired(const Key& key, uint32_t hash)
+	{
+		Entry* entry = m_table.Find(key, hash);
+		if(entry != nullptr && entry->expire_time != 0 && entry->expire_time <= GetTickMilliTime())
+		{
+			Remove(entry);
+			++m_expire_count;
+			return nullptr;
+		}
+		return entry;
+	}
+
+	//查找并更新命中统计，通知淘汰策略
+	Entry* Find_(const Key& key, uint32_t hash)
+	{
+		if(m_sketch)
+		{
+			m_sketch->Increment(hash);
+		}
+
+		Entry* entry = FindUnexpired(key, hash);
+		if(entry == nullptr)
+		{
+			++m_miss_count;
+			return nullptr;
+		}
+
+		++m_hit_count;
+
+		m_policy.Touch(entry);
+		Reserve(0);
+
+		return entry;
+	}
+
+	bool Delete(const Key& key, uint32_t hash)
+	{
+		bool found;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Invalidate(key, hash);
+
+			Entry* entry = m_table.Find(key, hash);
+			found = (entry != nullptr);
+			if(m_tier && HasTierCopy(key, hash))
+			{
+				if(found)
+				{
+					QueueTierOp(entry, false);
+				}
+				else
+				{
+					//只用于保存key
+					Entry* holder = NewEntry(key, Value(), 0, hash);
+					QueueTierOp(holder, false);
+					holder->Unref();
+				}
+			}
+			if(found)
+			{
+				Remove(entry);
+			}
+		}
+		DrainTier();
+		return found;
+	}
+
+	//key被Delete或插入新值：正在锁外加载或读文件的结果不再放回内存
+	void Invalidate(const Key& key, uint32_t hash)
+	{
+		if(m_load_table.Count() != 0)
+		{
+			LoadCall* call = m_load_table.Find(key, hash);
+			if(call != nullptr)
+			{
+				call->stale = true;
+			}
+		}
+		for(size_t i = 0; i < m_tier_reads.size(); ++i)
+		{
+			TierRead* read = m_tier_reads[i];
+			if(read->hash == hash && read->key == key)
+			{
+				read->stale = true;
+			}
+		}
+	}
+
+	//持锁调用：排队写入entry或删除文件中entry->key的所有记录，解锁后由DrainTier执行
+	void QueueTierOp(Entry* entry, bool spill)
+	{
+		if(spill && entry->expire_time != 0 && entry->expire_time <= GetTickMilliTime())
+		{
+			return;
+		}
+		entry->ref.fetch_add(1, std::memory_order_relaxed);
+
+		TierOp op;
+		op.entry = entry;
+		op.spill = spill;
+		m_tier_ops.push_back(op);
+		++m_tier_op_num;
+	}
+
+	//持锁调用：key在队列中的最后一个操作
+	const TierOp* FindTierOp(const Key& key, uint32_t hash) const
+	{
+		for(size_t i = m_tier_ops.size(); i > 0; --i)
+		{
+			const TierOp& op = m_tier_ops[i - 1];
+			if(op.entry->hash == hash && op.entry->key == key)
+			{
+				return &op;
+			}
+		}
+		return nullptr;
+	}
+
+	//持锁调用：文件中有hash相同的记录，或者key有排队的操作
+	inline bool HasTierCopy(const Key& key, uint32_t hash) const
+	{
+		return m_tier->Contains(hash) || FindTierOp(key, hash) != nullptr;
+	}
+
+	//持锁调用：key有排队的操作时文件内容不确定，返回false表示不能读文件
+	//最后一个操作是写入时直接从该entry复制value，hit置true
+	bool CheckTierOps(const Key& key, uint32_t hash, Value& value, size_t& value_size, uint32_t& ttl_ms, bool& hit)
+	{
+		hit = false;
+		const TierOp* op = FindTierOp(key, hash);
+		if(op == nullptr)
+		{
+			return true;
+		}
+		if(op->spill)
+		{
+			const Entry* entry = op->entry;
+			ttl_ms = 0;
+			if(entry->expire_time != 0)
+			{
+				uint64_t now = GetTickMilliTime();
+				if(entry->expire_time <= now)
+				{
+					return false;
+				}
+				ttl_ms = (uint32_t)(entry->expire_time - now);
+			}
+			value = entry->value;
+			value_size = entry->value_size;
+			hit = true;
+		}
+		return false;
+	}
+
+	//内存未命中时读文件二级缓存，命中后放回内存，调用者不能持锁
+	bool GetTier(const Key& key, uint32_t hash, Value& value)
+	{
+		TierRead read(*this, key, hash);
+		size_t value_size = 0;
+		uint32_t ttl_ms = 0;
+		bool hit = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(!CheckTierOps(key, hash, value, value_size, ttl_ms, hit))
+			{
+				if(hit)
+				{
+					++m_tier_hit_count;
+					Add_(key, hash, value, value_size, ttl_ms, true);
+				}
+				return hit;
+			}
+			read.Register();
+		}
+
+		hit = ReadTier(key, hash, value, value_size, ttl_ms);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		read.Unregister();
+		if(hit)
+		{
+			++m_tier_hit_count;
+			if(!read.stale)
+			{
+				Add_(key, hash, value, value_size, ttl_ms, true);
+			}
+		}
+		return hit;
+	}
+
+	//按入队顺序执行排队的文件操作，调用者不能持锁；m_tier_mutex保证同时只有一个线程执行
+	//执行完才出队，执行期间Get仍能看到这些操作；操作抛出异常时也出队，避免阻塞后面的操作
+	void DrainTier()
+	{
+		if(m_tier_op_num == 0)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> tier_lock(m_tier_mutex);
+		std::vector<TierOp> ops;
+		for(;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				ops.assign(m_tier_ops.begin(), m_tier_ops.end());
+			}
+			if(ops.empty())
+			{
+				return;
+			}
+
+			struct PopGuard
+			{
+				LruCache& cache;
+				size_t& num;
+				~PopGuard()
+				{
+					cache.PopTierOps(num);
+				}
+			};
+			size_t done = 0;
+			PopGuard guard = {*this, done};
+			while(done < ops.size())
+			{
+				const TierOp& op = ops[done++];
+				if(op.spill)
+				{
+					SpillEntry(op.entry);
+				}
+				else
+				{
+					RemoveTierCopy(op.entry);
+				}
+			}
+		}
+	}
+
+	void PopTierOps(size_t num)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(size_t i = 0; i < num; ++i)
+		{
+			m_tier_ops.front().entry->Unref();
+			m_tier_ops.pop_front();
+		}
+		m_tier_op_num -= num;
+	}
+
+	//写入文件二级缓存：value_size + expire_time(tick) + key/value
+	//只在DrainTier中调用，m_spill_count由m_tier_mutex串行化
+	void SpillEntry(const Entry* entry)
+	{
+		if(entry->expire_time != 0 && entry->expire_time <= GetTickMilliTime())
+		{
+			return;
+		}
+
+		BlockBufferPtr buf = NewBlockBuffer(*m_tier_pool);
+		{
+			Packer pk(buf);
+			pk.Pack((uint64_t)entry->value_size);
+			pk.Pack((uint64_t)entry->expire_time);
+			m_tier_packer(pk, entry->key, entry->value);
+		}
+
+		const std::vector<Block>& blocks = buf->GetBlocks();
+		bool ok;
+		if(blocks.size() == 1)
+		{
+			ok = m_tier->Put(entry->hash, blocks[0].buf, blocks[0].size);
+		}
+		else
+		{
+			std::string data;
+			for(size_t i = 0; i < blocks.size(); ++i)
+			{
+				data.append((char*)blocks[i].buf, blocks[i].size);
+			}
+			ok = m_tier->Put(entry->hash, (byte_t*)data.data(), data.size());
+		}
+		if(ok)
+		{
+			++m_spill_count;
+		}
+	}
+
+	//删除文件中entry->key的所有记录：读出hash相同的记录逐条比较key，无法解析的记录也删除
+	void RemoveTierCopy(const Entry* entry)
+	{
+		std::vector<std::string> datas;
+		std::vector<uint64_t> ids;
+		if(!m_tier->Get(entry->hash, datas, &ids))
+		{
+			return;
+		}
+
+		for(size_t i = 0; i < datas.size(); ++i)
+		{
+			Value value;
+			uint64_t value_size = 0, expire_time = 0;
+			bool parsed = false;
+			if(UnpackTierRecord(datas[i], entry->key, value, value_size, expire_time, parsed) || !parsed)
+			{
+				m_tier->Remove(entry->hash, ids[i]);
+			}
+		}
+	}
+
+	//解析一条记录，key与参数相同时返回true；parsed表示是否解析成功
+	bool UnpackTierRecord(const std::string& data, const Key& key, Value& value, 
+						uint64_t& value_size, uint64_t& expire_time, bool& parsed)
+	{
+		BlockBufferPtr buf = NewBlockBuffer(*m_tier_pool);
+		Block* block = buf->Alloc(data.size());
+		memcpy(block->buf, data.data(), data.size());
+		block->size = data.size();
+
+		Unpacker up(buf);
+		Key record_key;
+		parsed = up.Unpack(value_size) && up.Unpack(expire_time) && m_tier_unpacker(up, record_key, value);
+		return parsed && record_key == key;
+	}
+
+	//同一hash可能有多条记录，按key校验，匹配前不修改value
+	bool ReadTier(const Key& key, uint32_t hash, Value& value, size_t& value_size, uint32_t& ttl_ms)
+	{
+		std::vector<std::string> datas;
+		if(!m_tier->Get(hash, datas))
+		{
+			return false;
+		}
+
+		for(size_t i = 0; i < datas.size(); ++i)
+		{
+			Value record_value;
+			uint64_t size = 0, expire_time = 0;
+			bool parsed = false;
+			if(!UnpackTierRecord(datas[i], key, record_value, size, expire_time, parsed))
+			{
+				continue;
+			}
+
+			ttl_ms = 0;
+			if(expire_time != 0)
+			{
+				uint64_t now = GetTickMilliTime();
+				if(expire_time <= now)
+				{
+					continue;
+				}
+				ttl_ms = (uint32_t)(expire_time - now);
+			}
+			value = std::move(record_value);
+			value_size = size;
+			return true;
+		}
+		return false;
+	}
+
+	void Remove(Entry* entry)
+	{
+		m_policy.Remove(entry);
+		Unlink(entry);
+	}
+
+	//从超时时间轮和索引中删除，释放cache持有的引用
+	void Unlink(Entry* entry)
+	{
+		if(entry->expire_time != 0)
+		{
+			ListDelete(&entry->expire_node);
+			--m_ttl_num;
+		}
+		m_table.Remove(entry);
+		entry->Unref();
+	}
+
+	inline List* ExpireSlot(uint64_t tick)
+	{
+		return &m_expire_wheel[tick & (EXPIRE_SLOT_NUM - 1)];
+	}
+
+	void AddExpire(Entry* entry, uint64_t expire_time)
+	{
+		if(!m_expire_wheel)
+		{
+			m_expire_wheel.reset(new List[EXPIRE_SLOT_NUM]);
+			for(uint32_t i = 0; i < EXPIRE_SLOT_NUM; ++i)
+			{
+				ListInit(&m_expire_wheel[i]);
+			}
+		}
+		if(m_ttl_num == 0)
+		{
+			m_expire_tick = GetTickMilliTime() / EXPIRE_TICK_MS;
+		}
+
+		entry->expire_time = expire_time;
+		uint64_t tick = expire_time / EXPIRE_TICK_MS;
+		if(tick < m_expire_tick + EXPIRE_SLOT_NUM)
+		{
+			ListAddTail(&entry->expire_node, ExpireSlot(tick));
+		}
+		else
+		{
+			ListAddTail(&entry->expire_node, &m_expire_far);
+		}
+		++m_ttl_num;
+	}
+
+	/**时间轮：slot中只有[m_expire_tick, m_expire_tick+EXPIRE_SLOT_NUM)内到期的entry，超出一圈的放在m_expire_far
+	 * 只扫描上次以来完整经过的tick（当前tick不扫描，其中到期的由Get时检查），每个slot扫描时整体到期，不会重复扫描
+	 * m_expire_far每半圈检查一次，把进入范围的entry移入slot
+	 */
+	void ExpireEntries()
+	{
+		if(m_ttl_num == 0)
+		{
+			return;
+		}
+
+		uint64_t now_tick = GetTickMilliTime() / EXPIRE_TICK_MS;
+		if(now_tick == m_expire_tick)
+		{
+			return;
+		}
+
+		uint64_t tick_num = MIN(now_tick - m_expire_tick, (uint64_t)EXPIRE_SLOT_NUM);
+		for(uint64_t tick = now_tick - tick_num; tick < now_tick; ++tick)
+		{
+			List* slot = ExpireSlot(tick);
+			while(!ListEmtpy(slot))
+			{
+				Remove(Entry::FromExpireNode(ListHead(slot)));
+				++m_expire_count;
+			}
+		}
+		m_expire_tick = now_tick;
+
+		if(now_tick >= m_expire_far_tick && !ListEmtpy(&m_expire_far))
+		{
+			ExpireFar();
+		}
+	}
+
+	void ExpireFar()
+	{
+		for(ListNode* node = ListHead(&m_expire_far); node != &m_expire_far; )
+		{
+			Entry* entry = Entry::FromExpireNode(node);
+			node = node->next;
+
+			uint64_t tick = entry->expire_time / EXPIRE_TICK_MS;
+			if(tick < m_expire_tick)
+			{
+				Remove(entry);
+				++m_expire_count;
+			}
+			else if(tick < m_expire_tick + EXPIRE_SLOT_NUM)
+			{
+				ListDelete(&entry->expire_node);
+				ListAddTail(&entry->expire_node, ExpireSlot(tick));
+			}
+		}
+		m_expire_far_tick = m_expire_tick + EXPIRE_SLOT_NUM / 2;
+	}
+
+	//需要淘汰时，新key的估计频率必须高于victim才准入
+	bool Admit(uint32_t hash, size_t charge)
+	{
+		Entry* victim = m_policy.Victim(charge);
+		if(victim == nullptr)
+		{
+			return true;
+		}
+		return m_sketch->Estimate(hash) > m_sketch->Estimate(victim->hash);
+	}
+
+	void Reserve(size_t charge)
+	{
+		Entry* entry;
+		while((entry = m_policy.Victim(charge)) != nullptr)
+		{
+			if(m_tier)
+			{
+				QueueTierOp(entry, true);
+			}
+			m_policy.Evict(entry);
+			Unlink(entry);
+			++m_evict_count;
+		}
+	}
+
+private:
+	std::mutex m_mutex;
+	Hash m_hash;
+
+	LruCounter m_hit_count;
+	LruCounter m_miss_count;
+	LruCounter m_insert_count;
+	LruCounter m_evict_count;
+	LruCounter m_expire_count;
+	LruCounter m_reject_count;
+	LruCounter m_spill_count;
+	LruCounter m_tier_hit_count;
+
+	std::unique_ptr<FrequencySketch> m_sketch;
+
+	std::unique_ptr<BlockPool> m_node_block_pool;
+	std::unique_ptr<MemoryPool> m_node_pool;
+	std::atomic<size_t> m_handle_num;		//Lookup返回且未Release的handle数，析构时必须为0
+	size_t m_node_overhead;
+
+	std::unique_ptr<LruFileTier> m_tier;
+	std::unique_ptr<BlockPool> m_tier_pool;
+	EntryPacker m_tier_packer;
+	EntryUnpacker m_tier_unpacker;
+	std::mutex m_tier_mutex;				//串行执行排队的文件操作
+	std::deque<TierOp> m_tier_ops;			//持锁时入队，执行完才出队
+	LruCounter m_tier_op_num;
+	std::vector<TierRead*> m_tier_reads;	//正在锁外读文件的key
+
+	LruTable<Entry> m_table;
+	LruTable<LoadCall> m_load_table;
+
+	Policy<Entry> m_policy;
+
+	//持久化文件：头部为magic+version，之后是若干chunk（chunk_size+entry_num+crc+数据），最后是FileTrailer
+	static const uint32_t FILE_MAGIC = 0x434C4658;	//"XFLC"
+	static const uint32_t FILE_VERSION = 3;
+	static const uint32_t FILE_TRAILER_MAGIC = 0x454C4658;	//"XFLE"
+	static const uint32_t FILE_TRAILER_SIZE = 4*sizeof(uint32_t) + sizeof(uint64_t);
+	static const uint32_t FILE_BLOCK_SIZE = 64*1024;
+	static const uint32_t FILE_CHUNK_BLOCKS = 4;		//达到该block数后开始新的chunk
+	static const uint32_t FILE_MAX_CHUNK_SIZE = 64*1024*1024;
+	static const uint32_t FILE_MIN_ENTRY_SIZE = 3;		//in_hot+value_size+expire_time至少各1字节
+
+	static const uint32_t EXPIRE_SLOT_NUM = 256;	//2的幂
+	static const uint32_t EXPIRE_TICK_MS = 100;
+
+	std::unique_ptr<List[]> m_expire_wheel;		//设置了ttl时才分配
+	List m_expire_far;				//超出时间轮一圈的entry
+	size_t m_ttl_num;
+	uint64_t m_expire_tick;			//下一个要扫描的tick
+	uint64_t m_expire_far_tick;		//下次检查m_expire_far的tick
+
+private:
+	LruCache(const LruCache&) = delete;
+	LruCache& operator=(const LruCache&) = delete;
 };
 
-template < class Key, class Value >
-class LruCache
+template <class Key, class Value, class Hash, template<class> class Policy>
+void LruCache<Key, Value, Hash, Policy>::MultiGetOrLoad(const std::vector<Key>& keys, std::vector<Value>& values, 
+						std::vector<bool>& found, const BatchLoader& loader, uint32_t ttl_ms/* = 0*/)
 {
-	typedef Node<Key, Value> LruNode;
-	typedef typename std::list<LruNode>::iterator NodeIterator;
+	std::vector<uint32_t> hashs;
+	std::vector<size_t> indexs;
+	PrepareBatch(keys, hashs, indexs);
 
-public:
-	LruCache(size_t max_size) : m_max_hot_size(max_size*0.6), m_max_cold_size(max_size-m_max_hot_size)
-	{
-		m_hit_count = 0;
-		m_miss_count = 0;
+	values.resize(keys.size());
+	found.assign(keys.size(), false);
 
-		m_hot_size = 0;
-		m_cold_size = 0;
-	}
-	~LruCache()
+	LoadBatch batch(*this);
+	BeginLoad(keys, hashs, indexs.data(), indexs.size(), values, found, batch);
+	LoadTier(batch, values, found);
+
+	if(!batch.keys.empty())
 	{
+		std::vector<Value> load_values(batch.keys.size());
+		std::vector<size_t> value_sizes(batch.keys.size(), 0);
+		std::vector<bool> loaded(batch.keys.size(), false);
+		loader(batch.keys, load_values, value_sizes, loaded);
 
+		EndLoad(batch, 0, load_values, value_sizes, loaded, values, found, ttl_ms);
 	}
-	
-public:	
-	void Add(const Key& key, const Value& value, size_t value_size)
+
+	//自己加载的call已完成，不会死锁
+	WaitLoads(batch, values, found);
+}
+
+template <class Key, class Value, class Hash, template<class> class Policy>
+bool LruCache<Key, Value, Hash, Policy>::SaveTo(const char* path, const EntryPacker& packer)
+{
+	//key/value插入后不再修改，加引用后可在锁外读取
+	//in_hot在锁外可能被修改，需在快照时记录
+	std::vector<Entry*> entrys;
+	std::vector<uint8_t> in_hots;
 	{
 		std::lock_guard<std::mutex> lock(m_mutex);
+		entrys.reserve(m_policy.Count());
+		in_hots.reserve(m_policy.Count());
+
+		m_policy.Foreach([&entrys, &in_hots](Entry* entry) {
+			entry->ref.fetch_add(1, std::memory_order_relaxed);
+			entrys.push_back(entry);
+			in_hots.push_back(entry->in_hot);
+		});
+	}
 
-		ReserveColdList(value_size);
+	//超时时间以系统时间保存，重启后tick时间不连续
+	uint64_t now_tick = GetTickMilliTime();
+	uint64_t now = GetCurrentMilliTime();
 
-		//判断是否已存在，存在则不操作
-		const auto it = m_cold_map.find(key);
-		if (it == m_cold_map.end())
+	std::string tmp_path = std::string(path) + ".tmp";
+	File file;
+	bool ok = file.Open(tmp_path.c_str(), File::OF_CREATE|File::OF_WRITEONLY|File::OF_TRUNCATE);
+
+	byte_t header[2*sizeof(uint32_t)];
+	EncodeFixed(EncodeFixed(header, FILE_MAGIC), FILE_VERSION);
+	ok = ok && (file.Write(header, sizeof(header)) == (int64_t)sizeof(header));
+	uint32_t file_crc = Crc32(header, sizeof(header));
+	uint32_t chunk_num = 0;
+	uint64_t total_entry_num = 0;
+
+	BlockPool pool;
+	ok = ok && pool.Init(FILE_BLOCK_SIZE, FILE_CHUNK_BLOCKS);
+
+	for(size_t i = 0; ok && i < entrys.size(); )
+	{
+		BlockBufferPtr buf = NewBlockBuffer(pool);
+		uint32_t entry_num = 0;
 		{
-			LruNode node = {key, value, value_size};
+			Packer pk(buf);
+			for(; i < entrys.size() && buf->GetBlocks().size() < FILE_CHUNK_BLOCKS; ++i)
+			{
+				const Entry* entry = entrys[i];
+				uint64_t expire_time = 0;
+				if(entry->expire_time != 0)
+				{
+					if(entry->expire_time <= now_tick)
+					{
+						continue;
+					}
+					expire_time = now + (entry->expire_time - now_tick);
+				}
 
-			m_cold_list.push_front(node);
-			m_cold_map[key] = m_cold_list.begin();
-			m_cold_size += value_size;
+				pk.Pack(in_hots[i]);
+				pk.Pack((uint64_t)entry->value_size);
+				pk.Pack(expire_time);
+				packer(pk, entry->key, entry->value);
+				++entry_num;
+			}
 		}
+		ok = WriteChunk(file, buf, entry_num, file_crc);
+		++chunk_num;
+		total_entry_num += entry_num;
 	}
 
-	bool Get(const Key& key, Value& value)
+	byte_t trailer[FILE_TRAILER_SIZE];
+	byte_t* ptr = EncodeFixed(EncodeFixed(EncodeFixed(EncodeFixed(trailer, FILE_TRAILER_MAGIC), chunk_num), 
+										total_entry_num), file_crc);
+	EncodeFixed(ptr, Crc32(trailer, ptr - trailer));
+	ok = ok && (file.Write(trailer, sizeof(trailer)) == (int64_t)sizeof(trailer));
+
+	ok = ok && file.Sync();
+	file.Close();
+	ok = ok && File::Rename(tmp_path.c_str(), path);
+	if(!ok)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		File::Remove(tmp_path.c_str());
+	}
 
-		const auto it = m_hot_map.find(key);
-		if (it != m_hot_map.end())
-		{
-			value = it->second->value;
-			++m_hit_count;	
+	for(size_t i = 0; i < entrys.size(); ++i)
+	{
+		entrys[i]->Unref();
+	}
+	return ok;
+}
 
-			LruNode node = *it->second;
-			m_hot_list.erase(it->second);
-			m_hot_list.push_front(node);
-			it->second = m_hot_list.begin();
+template <class Key, class Value, class Hash, template<class> class Policy>
+bool LruCache<Key, Value, Hash, Policy>::WriteChunk(File& file, BlockBufferPtr& buf, uint32_t entry_num, uint32_t& file_crc)
+{
+	const std::vector<Block>& blocks = buf->GetBlocks();
 
-			return true;
+	std::vector<iobuf_t> iobufs(blocks.size() + 1);
+	byte_t header[3*sizeof(uint32_t)];
+	uint64_t chunk_size = 0;
+	uint32_t crc = 0;
+	for(size_t i = 0; i < blocks.size(); ++i)
+	{
+		iobufs[i+1].iov_base = blocks[i].buf;
+		iobufs[i+1].iov_len = blocks[i].size;
+		chunk_size += blocks[i].size;
+		crc = Crc32(blocks[i].buf, blocks[i].size, crc);
+	}
+	if(chunk_size > FILE_MAX_CHUNK_SIZE)
+	{
+		return false;
+	}
+	EncodeFixed(EncodeFixed(EncodeFixed(header, (uint32_t)chunk_size), entry_num), crc);
+	iobufs[0].iov_base = header;
+	iobufs[0].iov_len = sizeof(header);
+
+	file_crc = Crc32(header, sizeof(header), file_crc);
+	for(size_t i = 0; i < blocks.size(); ++i)
+	{
+		file_crc = Crc32(blocks[i].buf, blocks[i].size, file_crc);
+	}
+
+	return file.Write(iobufs.data(), (int)iobufs.size()) == (int64_t)(sizeof(header) + chunk_size);
+}
+
+template <class Key, class Value, class Hash, template<class> class Policy>
+bool LruCache<Key, Value, Hash, Policy>::OpenFile(File& file, const char* path, FileTrailer& trailer, int64_t& data_end)
+{
+	if(!file.Open(path, File::OF_READONLY))
+	{
+		return false;
+	}
+
+	byte_t header[2*sizeof(uint32_t)];
+	if(file.Read(header, sizeof(header)) != (int64_t)sizeof(header))
+	{
+		return false;
+	}
+	const byte_t* ptr = header;
+	uint32_t magic = 0, version = 0;
+	DecodeFixed(ptr, header + sizeof(header), magic);
+	DecodeFixed(ptr, header + sizeof(header), version);
+	if(magic != FILE_MAGIC || version != FILE_VERSION)
+	{
+		return false;
+	}
+
+	//没有完整尾部的文件（写入中断、被截断）在装入任何entry之前拒绝
+	data_end = file.Size() - (int64_t)FILE_TRAILER_SIZE;
+	if(data_end < (int64_t)sizeof(header))
+	{
+		return false;
+	}
+	byte_t data[FILE_TRAILER_SIZE];
+	if(file.Read(data_end, data, sizeof(data)) != (int64_t)sizeof(data))
+	{
+		return false;
+	}
+	const byte_t* end = data + sizeof(data);
+	uint32_t trailer_crc = 0;
+	ptr = data;
+	DecodeFixed(ptr, end, magic);
+	DecodeFixed(ptr, end, trailer.chunk_num);
+	DecodeFixed(ptr, end, trailer.entry_num);
+	DecodeFixed(ptr, end, trailer.file_crc);
+	uint32_t data_crc = Crc32(data, ptr - data);
+	DecodeFixed(ptr, end, trailer_crc);
+	return magic == FILE_TRAILER_MAGIC && trailer_crc == data_crc;
+}
+
+template <class Key, class Value, class Hash, template<class> class Policy>
+bool LruCache<Key, Value, Hash, Policy>::CheckFile(const char* path)
+{
+	File file;
+	FileTrailer trailer;
+	int64_t data_end = 0;
+	return OpenFile(file, path, trailer, data_end);
+}
+
+template <class Key, class Value, class Hash, template<class> class Policy>
+bool LruCache<Key, Value, Hash, Policy>::ReadFile(const char* path, const EntryUnpacker& unpacker, const LoadHandler& handler)
+{
+	File file;
+	FileTrailer trailer;
+	int64_t data_end = 0;
+	if(!OpenFile(file, path, trailer, data_end))
+	{
+		return false;
+	}
+
+	BlockPool pool;
+	if(!pool.Init(FILE_BLOCK_SIZE, 1))
+	{
+		return false;
+	}
+	uint64_t now = GetCurrentMilliTime();
+
+	std::vector<LoadItem> items;
+
+	byte_t header[2*sizeof(uint32_t)];
+	EncodeFixed(EncodeFixed(header, FILE_MAGIC), FILE_VERSION);
+	uint32_t file_crc = Crc32(header, sizeof(header));
+	uint32_t chunk_num = 0;
+	uint64_t total_entry_num = 0;
+
+	int64_t offset = sizeof(header);
+	byte_t chunk_header[3*sizeof(uint32_t)];
+	while(offset < data_end)
+	{
+		if(data_end - offset < (int64_t)sizeof(chunk_header)
+			|| file.Read(offset, chunk_header, sizeof(chunk_header)) != (int64_t)sizeof(chunk_header))
+		{
+			return false;
 		}
-		const auto it2 = m_cold_map.find(key);
-		if(it2 != m_cold_map.end())
+		uint32_t chunk_size = 0, entry_num = 0, crc = 0;
+		const byte_t* ptr = chunk_header;
+		DecodeFixed(ptr, chunk_header + sizeof(chunk_header), chunk_size);
+		DecodeFixed(ptr, chunk_header + sizeof(chunk_header), entry_num);
+		DecodeFixed(ptr, chunk_header + sizeof(chunk_header), crc);
+		offset += sizeof(chunk_header);
+		if(chunk_size > FILE_MAX_CHUNK_SIZE || chunk_size > data_end - offset
+			|| entry_num > chunk_size / FILE_MIN_ENTRY_SIZE)
 		{
-			value = it2->second->value;
-			++m_hit_count;
+			return false;
+		}
 
-			LruNode node = *it2->second;
+		//整个chunk读入一个block，Packer保证单个字段不跨block
+		BlockBufferPtr buf = NewBlockBuffer(pool);
+		Block* block = buf->Alloc(chunk_size);
+		if(block->buf == nullptr || file.Read(offset, block->buf, chunk_size) != (int64_t)chunk_size
+			|| Crc32(block->buf, chunk_size) != crc)
+		{
+			return false;
+		}
+		block->size = chunk_size;
+		offset += chunk_size;
 
-			m_cold_size -= it2->second->value_size;
-			m_cold_list.erase(it2->second);
-			m_cold_map.erase(it2);
+		file_crc = Crc32(block->buf, chunk_size, Crc32(chunk_header, sizeof(chunk_header), file_crc));
+		++chunk_num;
+		total_entry_num += entry_num;
 
-			ReserveHotList(node.value_size);
+		items.resize(entry_num);
+		size_t item_num = 0;
+		Unpacker up(buf);
+		for(uint32_t i = 0; i < entry_num; ++i)
+		{
+			LoadItem& item = items[item_num];
+			uint64_t expire_time = 0;
+			if(!up.Unpack(item.in_hot) || !up.Unpack(item.value_size) || !up.Unpack(expire_time)
+				|| !unpacker(up, item.key, item.value))
+			{
+				return false;
+			}
 
-			m_hot_list.push_front(node);
-			m_hot_map[node.key] = m_hot_list.begin();
+			item.ttl_ms = 0;
+			if(expire_time != 0)
+			{
+				if(expire_time <= now)
+				{
+					continue;
+				}
+				item.ttl_ms = (uint32_t)MIN(expire_time - now, (uint64_t)UINT32_MAX);
+			}
+			++item_num;
+		}
 
-			return true;
+		if(handler)
+		{
+			handler(items, item_num);
 		}
+	}
 
-		++m_miss_count;
-		return false;
+	return chunk_num == trailer.chunk_num && total_entry_num == trailer.entry_num && file_crc == trailer.file_crc;
+}
+
+//按key的hash值分片，每个分片是独立的LruCache（各自的锁和容量）
+template < class Key, class Value, class Hash = LruHash<Key>, template<class> class Policy = LruSegmentPolicy >
+class ShardedLruCache
+{
+	typedef LruCache<Key, Value, Hash, Policy> Shard;
+
+public:
+	//shard_num: 分片数，向上取整到2的幂，max_size平均分配到各分片
+	//admission_entry_num: 非0时各分片启用TinyLFU准入
+	ShardedLruCache(size_t max_size, uint32_t shard_num = 16, size_t admission_entry_num = 0)
+	{
+		uint32_t num = 1;
+		while(num < shard_num)
+		{
+			num <<= 1;
+		}
+		m_shard_mask = num - 1;
+
+		m_shards.reserve(num);
+		for(uint32_t i = 0; i < num; ++i)
+		{
+			m_shards.emplace_back(new Shard(max_size / num, (admission_entry_num + num - 1) / num));
+		}
+	}
+	~ShardedLruCache()
+	{
+
+	}
+
+public:
+	void Add(const Key& key, const Value& value, size_t value_size, uint32_t ttl_ms = 0)
+	{
+		uint32_t hash = m_shards[0]->HashOf(key);
+		GetShard(hash).Add(key, hash, value, value_size, ttl_ms);
+	}
+
+	bool Get(const Key& key, Value& value)
+	{
+		uint32_t hash = m_shards[0]->HashOf(key);
+		return GetShard(hash).Get(key, hash, value);
 	}
 
 	bool Delete(const Key& key)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
+		uint32_t hash = m_shards[0]->HashOf(key);
+		return GetShard(hash).Delete(key, hash);
+	}
+
+	const typename Shard::Handle* Lookup(const Key& key)
+	{
+		uint32_t hash = m_shards[0]->HashOf(key);
+		return GetShard(hash).Lookup(key, hash);
+	}
+
+	//必须在cache析构前调用
+	void Release(const typename Shard::Handle* handle)
+	{
+		GetShard(handle->hash).Release(handle);
+	}
+
+	bool GetOrLoad(const Key& key, Value& value, const typename Shard::Loader& loader, uint32_t ttl_ms = 0)
+	{
+		uint32_t hash = m_shards[0]->HashOf(key);
+		return GetShard(hash).GetOrLoad(key, hash, value, loader, ttl_ms);
+	}
 
-		const auto it = m_hot_map.find(key);
-		if (it != m_hot_map.end())
+	//所有分片中需要加载的key合并为一次loader调用
+	void MultiGetOrLoad(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found,
+						const typename Shard::BatchLoader& loader, uint32_t ttl_ms = 0)
+	{
+		std::vector<uint32_t> hashs(keys.size());
+		for(size_t i = 0; i < keys.size(); ++i)
 		{
-			m_hot_size -= it->second->value_size;
-			m_hot_list.erase(it->second);
-			m_hot_map.erase(it);
-			return true;
+			hashs[i] = m_shards[0]->HashOf(keys[i]);
 		}
-		else
+		std::vector<size_t> indexs;
+		std::vector<size_t> offsets;
+		GroupByShard(hashs, hashs.size(), indexs, offsets);
+
+		values.resize(keys.size());
+		found.assign(keys.size(), false);
+
+		//loader抛出异常时各分片的batch在析构时分别清理
+		std::vector<std::unique_ptr<typename Shard::LoadBatch>> batchs(m_shards.size());
+		std::vector<Key> load_keys;
+		std::vector<size_t> load_offsets(m_shards.size() + 1, 0);
+		for(size_t i = 0; i < m_shards.size(); ++i)
 		{
-			const auto it = m_cold_map.find(key);
-			if(it != m_cold_map.end())
+			batchs[i].reset(new typename Shard::LoadBatch(*m_shards[i]));
+			if(offsets[i] != offsets[i+1])
 			{
-				m_cold_size -= it->second->value_size;
-				m_cold_list.erase(it->second);
-				m_cold_map.erase(it);
-				return true;
+				m_shards[i]->BeginLoad(keys, hashs, &indexs[offsets[i]], offsets[i+1] - offsets[i], values, found, *batchs[i]);
+				m_shards[i]->LoadTier(*batchs[i], values, found);
+				load_keys.insert(load_keys.end(), batchs[i]->keys.begin(), batchs[i]->keys.end());
 			}
+			load_offsets[i+1] = load_keys.size();
 		}
 
-		return false;
-	}	
-	
+		if(!load_keys.empty())
+		{
+			std::vector<Value> load_values(load_keys.size());
+			std::vector<size_t> value_sizes(load_keys.size(), 0);
+			std::vector<bool> loaded(load_keys.size(), false);
+			loader(load_keys, load_values, value_sizes, loaded);
+
+			for(size_t i = 0; i < m_shards.size(); ++i)
+			{
+				if(load_offsets[i] != load_offsets[i+1])
+				{
+					m_shards[i]->EndLoad(*batchs[i], load_offsets[i], load_values, value_sizes, loaded, values, found, ttl_ms);
+				}
+			}
+		}
+
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			m_shards[i]->WaitLoads(*batchs[i], values, found);
+		}
+	}
+
+	//按分片分组，每个分片整批只加锁一次
+	void MultiGet(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found)
+	{
+		std::vector<uint32_t> hashs(keys.size());
+		for(size_t i = 0; i < keys.size(); ++i)
+		{
+			hashs[i] = m_shards[0]->HashOf(keys[i]);
+		}
+		std::vector<size_t> indexs;
+		std::vector<size_t> offsets;
+		GroupByShard(hashs, hashs.size(), indexs, offsets);
+
+		values.resize(keys.size());
+		found.assign(keys.size(), false);
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			if(offsets[i] != offsets[i+1])
+			{
+				m_shards[i]->MultiGet(keys, hashs, &indexs[offsets[i]], offsets[i+1] - offsets[i], values, found);
+			}
+		}
+	}
+
+	void MultiAdd(const std::vector<Key>& keys, const std::vector<Value>& values, 
+				const std::vector<size_t>& value_sizes, uint32_t ttl_ms = 0)
+	{
+		std::vector<uint32_t> hashs(keys.size());
+		for(size_t i = 0; i < keys.size(); ++i)
+		{
+			hashs[i] = m_shards[0]->HashOf(keys[i]);
+		}
+		std::vector<size_t> indexs;
+		std::vector<size_t> offsets;
+		GroupByShard(hashs, hashs.size(), indexs, offsets);
+
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			if(offsets[i] != offsets[i+1])
+			{
+				m_shards[i]->MultiAdd(keys, hashs, &indexs[offsets[i]], offsets[i+1] - offsets[i], values, value_sizes, ttl_ms);
+			}
+		}
+	}
+
+	void Expire()
+	{
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			m_shards[i]->Expire();
+		}
+	}
+
 	size_t Size()
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-		return m_hot_size + m_cold_size;		
+		size_t size = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			size += m_shards[i]->Size();
+		}
+		return size;
 	}
 
-private:
-	void ReserveColdList(size_t value_size)
+	size_t HitCount()
 	{
-		while(!m_cold_list.empty() && m_cold_size + value_size > m_max_cold_size)
+		size_t count = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
 		{
-			auto node = m_cold_list.back();
+			count += m_shards[i]->HitCount();
+		}
+		return count;
+	}
 
-			m_cold_size -= node.value_size;
-			m_cold_map.erase(node.key);
-			m_cold_list.pop_back();
+	size_t MissCount()
+	{
+		size_t count = 0;
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			count += m_shards[i]->MissCount();
 		}
+		return count;
 	}
 
-	void ReserveHotList(size_t value_size)
+	LruCacheStats Stats()
 	{
-		while(!m_hot_list.empty() && m_hot_size + value_size > m_max_hot_size)
+		LruCacheStats stats;
+		for(size_t i = 0; i < m_shards.size(); ++i)
 		{
-			LruNode node = m_hot_list.back();
+			stats.Merge(m_shards[i]->Stats());
+		}
+		return stats;
+	}
 
-			m_hot_size -= node.value_size;
-			m_hot_map.erase(node.key);
-			m_hot_list.pop_back();
+	bool EnableNodePool(uint32_t block_size = 64*1024, uint32_t cache_num = 0)
+	{
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			if(!m_shards[i]->EnableNodePool(block_size, cache_num))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
 
-			m_cold_size += node.value_size;
-			m_cold_list.push_front(node);
-			auto it = m_cold_map.insert(std::make_pair(node.key, m_cold_list.begin()));
-			if(!it.second)
+	//分片i使用子目录"dir/i"，max_file_size平均分配
+	bool EnableFileTier(const char* dir, uint64_t max_file_size, const typename Shard::EntryPacker& packer, 
+						const typename Shard::EntryUnpacker& unpacker, uint32_t segment_size = 16*1024*1024)
+	{
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			std::string shard_dir = std::string(dir) + "/" + std::to_string(i);
+			if(!m_shards[i]->EnableFileTier(shard_dir.c_str(), max_file_size / m_shards.size(), packer, unpacker, segment_size))
 			{
-				m_cold_size -= it.first->second->value_size;
-				m_cold_list.erase(it.first->second);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**分片i保存到"path.<generation>.i"，generation比当前清单中的大1，不覆盖清单引用的文件
+	 * 全部写完后改名清单文件path（记录generation和文件数），改名是唯一的提交点，之前失败或中断时旧的保存完整可用
+	 * 提交后删除旧generation的分片文件
+	 */
+	bool SaveTo(const char* path, const typename Shard::EntryPacker& packer)
+	{
+		uint64_t old_generation = 0;
+		uint32_t old_file_num = 0;
+		bool has_old = ReadManifest(path, old_generation, old_file_num);
+		uint64_t generation = has_old ? old_generation + 1 : 1;
+
+		bool ok = true;
+		for(size_t i = 0; ok && i < m_shards.size(); ++i)
+		{
+			ok = m_shards[i]->SaveTo(ShardPath(path, generation, i).c_str(), packer);
+		}
+		ok = ok && WriteManifest(path, generation, m_shards.size());
+		if(!ok)
+		{
+			//本次写的文件没有被清单引用
+			RemoveShardFiles(path, generation, 0);
+			return false;
+		}
+
+		//旧generation的文件不再被引用；以前中断的保存可能在本generation留下更多的分片文件
+		if(has_old)
+		{
+			RemoveShardFiles(path, old_generation, 0);
+		}
+		RemoveShardFiles(path, generation, m_shards.size());
+		return true;
+	}
 
-				it.first->second = m_cold_list.begin();
+	/**只读取清单中的文件，按key重新分片装入，分片数可以与保存时不同
+	 * 先检查所有文件的头部和尾部，不完整时不装入任何entry；之后每个文件只读一遍，
+	 * 读到损坏的数据时删除本次已装入的entry
+	 */
+	bool LoadFrom(const char* path, const typename Shard::EntryUnpacker& unpacker)
+	{
+		uint64_t generation = 0;
+		uint32_t file_num = 0;
+		if(!ReadManifest(path, generation, file_num))
+		{
+			return false;
+		}
+		for(uint32_t i = 0; i < file_num; ++i)
+		{
+			if(!Shard::CheckFile(ShardPath(path, generation, i).c_str()))
+			{
+				return false;
 			}
 		}
+
+		std::vector<std::vector<typename Shard::Entry*>> loaded(m_shards.size());
+		bool ok = true;
+		for(uint32_t i = 0; ok && i < file_num; ++i)
+		{
+			ok = Shard::ReadFile(ShardPath(path, generation, i).c_str(), unpacker, 
+				[this, &loaded](const std::vector<typename Shard::LoadItem>& items, size_t item_num) {
+					std::vector<uint32_t> hashs(item_num);
+					for(size_t i = 0; i < item_num; ++i)
+					{
+						hashs[i] = m_shards[0]->HashOf(items[i].key);
+					}
+					std::vector<size_t> indexs;
+					std::vector<size_t> offsets;
+					GroupByShard(hashs, item_num, indexs, offsets);
+
+					for(size_t i = 0; i < m_shards.size(); ++i)
+					{
+						if(offsets[i] != offsets[i+1])
+						{
+							m_shards[i]->LoadItems(items, hashs, &indexs[offsets[i]], offsets[i+1] - offsets[i], loaded[i]);
+						}
+					}
+				});
+		}
+
+		for(size_t i = 0; i < m_shards.size(); ++i)
+		{
+			m_shards[i]->FinishLoadItems(loaded[i], !ok);
+		}
+		return ok;
+	}
+
+	inline size_t ShardNum() const
+	{
+		return m_shards.size();
 	}
 
 private:
-	const size_t m_max_hot_size;
-	const size_t m_max_cold_size;
+	//分片取hash低位，分片内的索引取高位（见LruTable::Index）
+	inline uint32_t ShardIndex(uint32_t hash) const
+	{
+		return (hash ^ (hash >> 16)) & m_shard_mask;
+	}
+	inline Shard& GetShard(uint32_t hash)
+	{
+		return *m_shards[ShardIndex(hash)];
+	}
 
-	std::mutex m_mutex;
+	static std::string ShardPath(const char* path, uint64_t generation, size_t index)
+	{
+		return std::string(path) + "." + std::to_string(generation) + "." + std::to_string(index);
+	}
 
-	size_t m_hit_count;
-	size_t m_miss_count;
+	//从begin开始删除generation的分片文件，直到遇到不存在的文件
+	static void RemoveShardFiles(const char* path, uint64_t generation, size_t begin)
+	{
+		for(size_t i = begin; ; ++i)
+		{
+			std::string shard_path = ShardPath(path, generation, i);
+			if(!File::Exist(shard_path.c_str()))
+			{
+				break;
+			}
+			File::Remove(shard_path.c_str());
+		}
+	}
+
+	//清单文件：magic+version+generation+文件数+crc，先写临时文件再改名
+	static bool WriteManifest(const char* path, uint64_t generation, size_t file_num)
+	{
+		byte_t data[4*sizeof(uint32_t) + sizeof(uint64_t)];
+		byte_t* ptr = EncodeFixed(EncodeFixed(EncodeFixed(EncodeFixed(data, MANIFEST_MAGIC), MANIFEST_VERSION), 
+												generation), (uint32_t)file_num);
+		EncodeFixed(ptr, Crc32(data, ptr - data));
+
+		std::string tmp_path = std::string(path) + ".tmp";
+		File file;
+		bool ok = file.Open(tmp_path.c_str(), File::OF_CREATE|File::OF_WRITEONLY|File::OF_TRUNCATE)
+				&& file.Write(data, sizeof(data)) == (int64_t)sizeof(data) && file.Sync();
+		file.Close();
+		ok = ok && File::Rename(tmp_path.c_str(), path);
+		if(!ok)
+		{
+			File::Remove(tmp_path.c_str());
+		}
+		return ok;
+	}
+
+	static bool ReadManifest(const char* path, uint64_t& generation, uint32_t& file_num)
+	{
+		File file;
+		byte_t data[4*sizeof(uint32_t) + sizeof(uint64_t)];
+		if(!file.Open(path, File::OF_READONLY) || file.Read(data, sizeof(data)) != (int64_t)sizeof(data))
+		{
+			return false;
+		}
+		const byte_t* ptr = data;
+		const byte_t* end = data + sizeof(data);
+		uint32_t magic = 0, version = 0, crc = 0;
+		DecodeFixed(ptr, end, magic);
+		DecodeFixed(ptr, end, version);
+		DecodeFixed(ptr, end, generation);
+		DecodeFixed(ptr, end, file_num);
+		uint32_t data_crc = Crc32(data, ptr - data);
+		DecodeFixed(ptr, end, crc);
+		return magic == MANIFEST_MAGIC && version == MANIFEST_VERSION && crc == data_crc;
+	}
+
+	//计数排序：分片i的下标为indexs[offsets[i], offsets[i+1])
+	void GroupByShard(const std::vector<uint32_t>& hashs, size_t num, 
+					std::vector<size_t>& indexs, std::vector<size_t>& offsets)
+	{
+		indexs.resize(num);
+		offsets.assign(m_shards.size() + 1, 0);
+
+		for(size_t i = 0; i < num; ++i)
+		{
+			++offsets[ShardIndex(hashs[i]) + 1];
+		}
+		for(size_t i = 1; i < offsets.size(); ++i)
+		{
+			offsets[i] += offsets[i-1];
+		}
 
-	size_t m_hot_size;
-	std::list<LruNode> m_hot_list;
-	std::unordered_map<Key, NodeIterator> m_hot_map;
+		std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < num; ++i)
+		{
+			indexs[pos[ShardIndex(hashs[i])]++] = i;
+		}
+	}
 
-	size_t m_cold_size;
-	std::list<LruNode> m_cold_list;
-	std::unordered_map<Key, NodeIterator> m_cold_map;
-	
 private:
-	LruCache(const LruCache&) = delete;
-	LruCache& operator=(const LruCache&) = delete;
+	static const uint32_t MANIFEST_MAGIC = 0x4D4C4658;	//"XFLM"
+	static const uint32_t MANIFEST_VERSION = 2;
+
+	uint32_t m_shard_mask;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+
+private:
+	ShardedLruCache(const ShardedLruCache&) = delete;
+	ShardedLruCache& operator=(const ShardedLruCache&) = delete;
 };
 
-} 
+}
 
 #endif
 
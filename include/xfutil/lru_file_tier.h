@@ -0,0 +1,128 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_lru_file_tier_h__
+#define __xfutil_lru_file_tier_h__
+
+#include <mutex>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include "xfutil/strutil.h"
+#include "xfutil/file.h"
+
+namespace xfutil
+{
+
+//LruCache的文件二级缓存：记录追加写入固定大小的段文件，内存索引为hash->位置
+//同一hash可能对应多条记录（hash冲突），由调用者校验key，按Get返回的记录id删除
+//总大小超限时回收段：存活数据不超过一半的段把存活记录搬到新段，否则直接丢弃最旧的段
+//写入由m_write_mutex串行化，文件读写都不持有m_mutex，Get/Contains/Remove不会等待磁盘IO
+class LruFileTier
+{
+	struct Location
+	{
+		uint32_t segment_id;
+		uint32_t offset;
+		uint32_t size;		//包含记录头
+	};
+
+	struct Segment
+	{
+		std::shared_ptr<File> file;
+		uint32_t size;
+		uint32_t live_size;
+	};
+
+public:
+	LruFileTier();
+	~LruFileTier();
+
+public:
+	/**打开目录，段文件名为"<id>.seg"，已有的同名文件会被截断
+	 * max_size: 所有段文件的总大小上限
+	 * segment_size: 单个段文件的大小
+	 */
+	bool Open(const char* dir, uint64_t max_size, uint32_t segment_size = 16*1024*1024);
+
+	/**追加一条记录，记录超过段大小时返回false
+	 * 写满的段刷盘、新建段和回收都在这里进行，只持有m_write_mutex
+	 */
+	bool Put(uint32_t hc, const byte_t* data, uint32_t size);
+
+	/**读出hash相同的所有记录，ids非空时同时返回各记录的id*/
+	bool Get(uint32_t hc, std::vector<std::string>& datas, std::vector<uint64_t>* ids = nullptr);
+
+	/**是否有hash相同的记录*/
+	bool Contains(uint32_t hc);
+
+	/**按Get返回的id删除一条记录，记录已被删除或回收时搬到了新位置则返回false*/
+	bool Remove(uint32_t hc, uint64_t id);
+
+	/**记录数*/
+	size_t Count();
+
+	/**段文件总大小*/
+	uint64_t Size();
+
+private:
+	static inline uint64_t LocationID(const Location& loc)
+	{
+		return ((uint64_t)loc.segment_id << 32) | loc.offset;
+	}
+
+	//以下在持有m_write_mutex时调用
+	bool NewSegment();
+	bool Flush();
+	//old非空时是回收搬迁：old已被删除则只占用空间、不建索引
+	bool Write(uint32_t hc, const byte_t* data, uint32_t size, const Location* old);
+	void Collect();
+
+	//以下在持有m_mutex时调用
+	void Append(uint32_t hc, const byte_t* data, uint32_t size);
+	bool EraseLocation(uint32_t hc, uint32_t segment_id, uint32_t offset);
+
+private:
+	static const uint32_t RECORD_HEAD_SIZE = 2*sizeof(uint32_t);	//size+hash
+	static const uint32_t FLUSH_SIZE = 256*1024;
+
+	std::mutex m_write_mutex;
+	std::mutex m_mutex;		//保护以下所有成员
+	std::string m_dir;
+	uint64_t m_max_size;
+	uint32_t m_segment_size;
+
+	std::map<uint32_t, Segment> m_segments;		//id递增，最后一个是当前写的段
+	uint32_t m_next_segment_id;
+	uint64_t m_total_size;
+
+	//当前段：[m_buf_offset, m_active_size)还在内存中，m_buf只由写入者修改，刷盘时可在锁外读
+	uint32_t m_active_id;
+	uint32_t m_active_size;
+	uint32_t m_buf_offset;
+	std::string m_buf;
+
+	std::unordered_multimap<uint32_t, Location> m_index;
+
+private:
+	LruFileTier(const LruFileTier&) = delete;
+	LruFileTier& operator=(const LruFileTier&) = delete;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,822 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_lru_policy_h__
+#define __xfutil_lru_policy_h__
+
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include "xfutil/types.h"
+#include "xfutil/list.h"
+
+namespace xfutil
+{
+
+//只在持锁时修改、读取不加锁的计数器：写者已被锁串行化，用relaxed load/store代替原子加
+class LruCounter
+{
+public:
+	LruCounter() : m_value(0)
+	{}
+
+public:
+	inline operator size_t() const
+	{
+		return m_value.load(std::memory_order_relaxed);
+	}
+	inline LruCounter& operator=(size_t v)
+	{
+		m_value.store(v, std::memory_order_relaxed);
+		return *this;
+	}
+	inline LruCounter& operator+=(size_t v)
+	{
+		m_value.store(m_value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+		return *this;
+	}
+	inline LruCounter& operator-=(size_t v)
+	{
+		m_value.store(m_value.load(std::memory_order_relaxed) - v, std::memory_order_relaxed);
+		return *this;
+	}
+	inline LruCounter& operator++()
+	{
+		return *this += 1;
+	}
+	inline LruCounter& operator--()
+	{
+		return *this -= 1;
+	}
+
+private:
+	std::atomic<size_t> m_value;
+
+private:
+	LruCounter(const LruCounter&) = delete;
+	LruCounter& operator=(const LruCounter&) = delete;
+};
+
+//统计快照
+struct LruCacheStats
+{
+	LruCacheStats()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	size_t hit_count;
+	size_t miss_count;
+	size_t insert_count;
+	size_t evict_count;		//容量不足淘汰
+	size_t expire_count;	//ttl超时回收
+	size_t reject_count;	//TinyLFU拒绝准入
+	size_t promote_count;	//cold->hot
+	size_t demote_count;	//hot->cold
+	size_t spill_count;		//淘汰时写入文件二级缓存
+	size_t tier_hit_count;	//内存未命中、文件二级缓存命中
+
+	size_t hot_size;
+	size_t hot_num;
+	size_t max_hot_size;
+	size_t cold_size;
+	size_t cold_num;
+	size_t max_cold_size;
+
+	double HitRatio() const
+	{
+		size_t total = hit_count + miss_count;
+		return (total != 0) ? (double)hit_count / total : 0.0;
+	}
+
+	void Merge(const LruCacheStats& other)
+	{
+		hit_count += other.hit_count;
+		miss_count += other.miss_count;
+		insert_count += other.insert_count;
+		evict_count += other.evict_count;
+		expire_count += other.expire_count;
+		reject_count += other.reject_count;
+		promote_count += other.promote_count;
+		demote_count += other.demote_count;
+		spill_count += other.spill_count;
+		tier_hit_count += other.tier_hit_count;
+
+		hot_size += other.hot_size;
+		hot_num += other.hot_num;
+		max_hot_size += other.max_hot_size;
+		cold_size += other.cold_size;
+		cold_num += other.cold_num;
+		max_cold_size += other.max_cold_size;
+	}
+};
+
+
+//淘汰策略挂在entry上的状态，由LruPolicyLinkOf<Policy>::Type指定，默认为空不占entry的空间
+struct LruEmptyLink
+{
+};
+
+//GDSF使用的entry状态
+struct LruGdsfLink
+{
+	double priority;
+	uint32_t freq;
+	uint32_t heap_index;
+};
+
+//需要在entry上保存状态的策略特化此模板
+template<template<class> class Policy>
+struct LruPolicyLinkOf
+{
+	typedef LruEmptyLink Type;
+};
+
+/**LruCache的淘汰策略，作为模板参数传给LruCache，所有方法都在cache持锁时调用
+ * Entry: 继承ListNode和LruPolicyLinkOf<Policy>::Type，有charge/hash/in_hot成员
+ * 策略需提供以下方法：
+ *   Size/Count:   当前占用的容量和entry数量，可不加锁读取
+ *   BeforeInsert: 新key通过准入判断后、腾空间之前调用，被拒绝的key不调用
+ *   Insert:       插入新entry，调用前已腾出空间
+ *   Touch:        命中，之后调用者会按Victim(0)淘汰
+ *   Remove:       删除或超时
+ *   Evict:        因容量不足淘汰
+ *   Victim:       为charge腾出空间时下一个要淘汰的entry，不需要淘汰时返回nullptr，不改变状态
+ *   Fits/Load:    从文件装入时不触发淘汰，in_hot为保存时的位置
+ *   Foreach:      按保留优先级从高到低遍历，func可以释放entry
+ *   Stats:        填充统计中的promote/demote和hot/cold部分
+ */
+
+//分段LRU：新entry进入cold，cold中再次命中提升到hot，hot按比例限制大小，超出的降级到cold
+template<class Entry>
+class LruSegmentPolicy
+{
+public:
+	explicit LruSegmentPolicy(size_t max_size)
+		: m_max_hot_size(max_size*0.6), m_max_cold_size(max_size-m_max_hot_size)
+	{
+		ListInit(&m_hot_list);
+		ListInit(&m_cold_list);
+	}
+
+public:
+	inline size_t Size() const
+	{
+		return m_hot_size + m_cold_size;
+	}
+
+	inline size_t Count() const
+	{
+		return m_hot_num + m_cold_num;
+	}
+
+	inline void BeforeInsert(uint32_t hash)
+	{
+	}
+
+	void Insert(Entry* entry)
+	{
+		entry->in_hot = false;
+		ListAddHead(entry, &m_cold_list);
+		m_cold_size += entry->charge;
+		++m_cold_num;
+	}
+
+	//hot淘汰的entry进入cold，cold可能超限
+	void Touch(Entry* entry)
+	{
+		ListDelete(entry);
+		if(!entry->in_hot)
+		{
+			//cold命中，提升到hot
+			m_cold_size -= entry->charge;
+			--m_cold_num;
+
+			ReserveHotList(entry->charge);
+
+			entry->in_hot = true;
+			m_hot_size += entry->charge;
+			++m_hot_num;
+			++m_promote_count;
+		}
+		ListAddHead(entry, &m_hot_list);
+	}
+
+	void Remove(Entry* entry)
+	{
+		if(entry->in_hot)
+		{
+			m_hot_size -= entry->charge;
+			--m_hot_num;
+		}
+		else
+		{
+			m_cold_size -= entry->charge;
+			--m_cold_num;
+		}
+		ListDelete(entry);
+	}
+
+	inline void Evict(Entry* entry)
+	{
+		Remove(entry);
+	}
+
+	Entry* Victim(size_t charge) const
+	{
+		if(ListEmtpy(&m_cold_list) || m_cold_size + charge <= m_max_cold_size)
+		{
+			return nullptr;
+		}
+		return static_cast<Entry*>(ListTail(&m_cold_list));
+	}
+
+	//hot放不下时放入cold
+	bool Fits(size_t charge, bool& in_hot) const
+	{
+		if(in_hot && m_hot_size + charge > m_max_hot_size)
+		{
+			in_hot = false;
+		}
+		return in_hot || m_cold_size + charge <= m_max_cold_size;
+	}
+
+	void Load(Entry* entry)
+	{
+		if(entry->in_hot)
+		{
+			ListAddTail(entry, &m_hot_list);
+			m_hot_size += entry->charge;
+			++m_hot_num;
+		}
+		else
+		{
+			ListAddTail(entry, &m_cold_list);
+			m_cold_size += entry->charge;
+			++m_cold_num;
+		}
+	}
+
+	//hot、cold各自从新到旧
+	template<class Func>
+	void Foreach(const Func& func) const
+	{
+		ForeachList(&m_hot_list, func);
+		ForeachList(&m_cold_list, func);
+	}
+
+	void Stats(LruCacheStats& stats) const
+	{
+		stats.promote_count = m_promote_count;
+		stats.demote_count = m_demote_count;
+
+		stats.hot_size = m_hot_size;
+		stats.hot_num = m_hot_num;
+		stats.max_hot_size = m_max_hot_size;
+		stats.cold_size = m_cold_size;
+		stats.cold_num = m_cold_num;
+		stats.max_cold_size = m_max_cold_size;
+	}
+
+private:
+	void ReserveHotList(size_t charge)
+	{
+		while(!ListEmtpy(&m_hot_list) && m_hot_size + charge > m_max_hot_size)
+		{
+			Entry* entry = static_cast<Entry*>(ListTail(&m_hot_list));
+			ListDelete(entry);
+
+			m_hot_size -= entry->charge;
+			--m_hot_num;
+			entry->in_hot = false;
+
+			m_cold_size += entry->charge;
+			++m_cold_num;
+			++m_demote_count;
+			ListAddHead(entry, &m_cold_list);
+		}
+	}
+
+	template<class Func>
+	static void ForeachList(const List* list, const Func& func)
+	{
+		for(ListNode* node = ListHead(list); node != list; )
+		{
+			Entry* entry = static_cast<Entry*>(node);
+			node = node->next;
+			func(entry);
+		}
+	}
+
+private:
+	const size_t m_max_hot_size;
+	const size_t m_max_cold_size;
+
+	LruCounter m_promote_count;
+	LruCounter m_demote_count;
+
+	LruCounter m_hot_size;
+	LruCounter m_hot_num;
+	List m_hot_list;
+
+	LruCounter m_cold_size;
+	LruCounter m_cold_num;
+	List m_cold_list;
+
+private:
+	LruSegmentPolicy(const LruSegmentPolicy&) = delete;
+	LruSegmentPolicy& operator=(const LruSegmentPolicy&) = delete;
+};
+
+//ARC淘汰时只保留hash和大小的记录
+struct LruGhost : public ListNode
+{
+	uint32_t hash;
+	bool in_b2;
+	size_t charge;
+};
+
+/**ARC：T1存放只访问过一次的entry，T2存放访问过多次的entry
+ * 淘汰的entry留下ghost记录（B1/B2），新key命中ghost时调整T1的目标大小target，
+ * 循环扫描等一次性访问只在T1中轮转，不会冲掉T2
+ * 统计中hot对应T2，cold对应T1；ghost按hash匹配，hash冲突只影响target的调整
+ */
+template<class Entry>
+class LruArcPolicy
+{
+public:
+	explicit LruArcPolicy(size_t max_size)
+		: m_max_size(max_size)
+	{
+		ListInit(&m_t1_list);
+		ListInit(&m_t2_list);
+		ListInit(&m_b1_list);
+		ListInit(&m_b2_list);
+
+		m_target = 0;
+		m_b1_size = 0;
+		m_b2_size = 0;
+		m_ghost_hit = GHOST_NONE;
+	}
+	~LruArcPolicy()
+	{
+		ClearGhosts(&m_b1_list);
+		ClearGhosts(&m_b2_list);
+	}
+
+public:
+	inline size_t Size() const
+	{
+		return m_t1_size + m_t2_size;
+	}
+
+	inline size_t Count() const
+	{
+		return m_t1_num + m_t2_num;
+	}
+
+	//命中B1说明T1太小，命中B2说明T2太小，按另一侧与本侧ghost的比例调整target
+	void BeforeInsert(uint32_t hash)
+	{
+		m_ghost_hit = GHOST_NONE;
+
+		auto it = m_ghosts.find(hash);
+		if(it == m_ghosts.end())
+		{
+			return;
+		}
+		LruGhost* ghost = it->second;
+		if(ghost->in_b2)
+		{
+			size_t delta = MAX(ghost->charge, (m_b2_size != 0) ? ghost->charge * m_b1_size / m_b2_size : 0);
+			m_target = (m_target > delta) ? m_target - delta : 0;
+			m_ghost_hit = GHOST_B2;
+		}
+		else
+		{
+			size_t delta = MAX(ghost->charge, (m_b1_size != 0) ? ghost->charge * m_b2_size / m_b1_size : 0);
+			m_target = MIN(m_target + delta, m_max_size);
+			m_ghost_hit = GHOST_B1;
+		}
+		RemoveGhost(ghost);
+	}
+
+	//命中ghost的key直接进入T2
+	void Insert(Entry* entry)
+	{
+		entry->in_hot = (m_ghost_hit != GHOST_NONE);
+		m_ghost_hit = GHOST_NONE;
+		Load(entry, true);
+	}
+
+	void Touch(Entry* entry)
+	{
+		ListDelete(entry);
+		if(!entry->in_hot)
+		{
+			m_t1_size -= entry->charge;
+			--m_t1_num;
+
+			entry->in_hot = true;
+			m_t2_size += entry->charge;
+			++m_t2_num;
+			++m_promote_count;
+		}
+		ListAddHead(entry, &m_t2_list);
+	}
+
+	void Remove(Entry* entry)
+	{
+		if(entry->in_hot)
+		{
+			m_t2_size -= entry->charge;
+			--m_t2_num;
+		}
+		else
+		{
+			m_t1_size -= entry->charge;
+			--m_t1_num;
+		}
+		ListDelete(entry);
+	}
+
+	void Evict(Entry* entry)
+	{
+		Remove(entry);
+		AddGhost(entry->hash, entry->charge, entry->in_hot);
+	}
+
+	//T1超过target时从T1淘汰，否则从T2淘汰
+	Entry* Victim(size_t charge) const
+	{
+		if(m_t1_size + m_t2_size + charge <= m_max_size)
+		{
+			return nullptr;
+		}
+		if(ListEmtpy(&m_t2_list)
+			|| (!ListEmtpy(&m_t1_list) && (m_t1_size > m_target || (m_ghost_hit == GHOST_B2 && m_t1_size >= m_target))))
+		{
+			return ListEmtpy(&m_t1_list) ? nullptr : static_cast<Entry*>(ListTail(&m_t1_list));
+		}
+		return static_cast<Entry*>(ListTail(&m_t2_list));
+	}
+
+	bool Fits(size_t charge, bool& in_hot) const
+	{
+		return m_t1_size + m_t2_size + charge <= m_max_size;
+	}
+
+	inline void Load(Entry* entry)
+	{
+		Load(entry, false);
+	}
+
+	template<class Func>
+	void Foreach(const Func& func) const
+	{
+		ForeachList(&m_t2_list, func);
+		ForeachList(&m_t1_list, func);
+	}
+
+	void Stats(LruCacheStats& stats) const
+	{
+		stats.promote_count = m_promote_count;
+
+		size_t target = m_target;
+		stats.hot_size = m_t2_size;
+		stats.hot_num = m_t2_num;
+		stats.max_hot_size = m_max_size - target;
+		stats.cold_size = m_t1_size;
+		stats.cold_num = m_t1_num;
+		stats.max_cold_size = target;
+	}
+
+private:
+	//at_head: 新插入的放在头部，装入时按文件顺序追加到尾部
+	void Load(Entry* entry, bool at_head)
+	{
+		List* list;
+		if(entry->in_hot)
+		{
+			list = &m_t2_list;
+			m_t2_size += entry->charge;
+			++m_t2_num;
+		}
+		else
+		{
+			list = &m_t1_list;
+			m_t1_size += entry->charge;
+			++m_t1_num;
+		}
+		if(at_head)
+		{
+			ListAddHead(entry, list);
+		}
+		else
+		{
+			ListAddTail(entry, list);
+		}
+	}
+
+	//|T1|+|B1|和总大小分别不超过1倍和2倍容量
+	void AddGhost(uint32_t hash, size_t charge, bool in_b2)
+	{
+		auto it = m_ghosts.find(hash);
+		if(it != m_ghosts.end())
+		{
+			RemoveGhost(it->second);
+		}
+
+		LruGhost* ghost = new LruGhost();
+		ghost->hash = hash;
+		ghost->in_b2 = in_b2;
+		ghost->charge = charge;
+		if(in_b2)
+		{
+			ListAddHead(ghost, &m_b2_list);
+			m_b2_size += charge;
+		}
+		else
+		{
+			ListAddHead(ghost, &m_b1_list);
+			m_b1_size += charge;
+		}
+		m_ghosts[hash] = ghost;
+
+		while(!ListEmtpy(&m_b1_list) && m_t1_size + m_b1_size > m_max_size)
+		{
+			RemoveGhost(static_cast<LruGhost*>(ListTail(&m_b1_list)));
+		}
+		while(!ListEmtpy(&m_b2_list) && m_t1_size + m_t2_size + m_b1_size + m_b2_size > 2 * m_max_size)
+		{
+			RemoveGhost(static_cast<LruGhost*>(ListTail(&m_b2_list)));
+		}
+	}
+
+	void RemoveGhost(LruGhost* ghost)
+	{
+		if(ghost->in_b2)
+		{
+			m_b2_size -= ghost->charge;
+		}
+		else
+		{
+			m_b1_size -= ghost->charge;
+		}
+		ListDelete(ghost);
+		m_ghosts.erase(ghost->hash);
+		delete ghost;
+	}
+
+	void ClearGhosts(List* list)
+	{
+		while(!ListEmtpy(list))
+		{
+			LruGhost* ghost = static_cast<LruGhost*>(ListHead(list));
+			ListDelete(ghost);
+			delete ghost;
+		}
+	}
+
+	template<class Func>
+	static void ForeachList(const List* list, const Func& func)
+	{
+		for(ListNode* node = ListHead(list); node != list; )
+		{
+			Entry* entry = static_cast<Entry*>(node);
+			node = node->next;
+			func(entry);
+		}
+	}
+
+private:
+	enum
+	{
+		GHOST_NONE = 0,
+		GHOST_B1,
+		GHOST_B2,
+	};
+
+	const size_t m_max_size;
+	LruCounter m_target;		//T1的目标大小
+	LruCounter m_promote_count;
+
+	LruCounter m_t1_size;
+	LruCounter m_t1_num;
+	List m_t1_list;
+
+	LruCounter m_t2_size;
+	LruCounter m_t2_num;
+	List m_t2_list;
+
+	size_t m_b1_size;
+	List m_b1_list;
+	size_t m_b2_size;
+	List m_b2_list;
+	std::unordered_map<uint32_t, LruGhost*> m_ghosts;
+	int m_ghost_hit;		//最近一次BeforeInsert命中的ghost，Insert后清除
+
+private:
+	LruArcPolicy(const LruArcPolicy&) = delete;
+	LruArcPolicy& operator=(const LruArcPolicy&) = delete;
+};
+
+/**GDSF：优先级 = L + 访问次数/charge，淘汰优先级最低的entry
+ * L取最近淘汰entry的优先级，使长期不访问的entry逐渐老化
+ * 同样的访问次数下小entry优先保留，适合大小差异大的场景；所有entry计入cold
+ */
+template<class Entry>
+class LruGdsfPolicy
+{
+public:
+	explicit LruGdsfPolicy(size_t max_size)
+		: m_max_size(max_size)
+	{
+		m_inflation = 0;
+	}
+
+public:
+	inline size_t Size() const
+	{
+		return m_size;
+	}
+
+	inline size_t Count() const
+	{
+		return m_num;
+	}
+
+	inline void BeforeInsert(uint32_t hash)
+	{
+	}
+
+	void Insert(Entry* entry)
+	{
+		entry->in_hot = false;
+		entry->freq = 1;
+		entry->priority = Priority(entry);
+
+		entry->heap_index = m_heap.size();
+		m_heap.push_back(entry);
+		SiftUp(entry->heap_index);
+
+		m_size += entry->charge;
+		++m_num;
+	}
+
+	//优先级只会增大，向下调整
+	void Touch(Entry* entry)
+	{
+		++entry->freq;
+		entry->priority = Priority(entry);
+		SiftDown(entry->heap_index);
+	}
+
+	void Remove(Entry* entry)
+	{
+		size_t i = entry->heap_index;
+		Entry* last = m_heap.back();
+		m_heap.pop_back();
+		if(last != entry)
+		{
+			Place(last, i);
+			SiftDown(i);
+			SiftUp(last->heap_index);
+		}
+
+		m_size -= entry->charge;
+		--m_num;
+	}
+
+	void Evict(Entry* entry)
+	{
+		m_inflation = entry->priority;
+		Remove(entry);
+	}
+
+	Entry* Victim(size_t charge) const
+	{
+		if(m_heap.empty() || m_size + charge <= m_max_size)
+		{
+			return nullptr;
+		}
+		return m_heap[0];
+	}
+
+	bool Fits(size_t charge, bool& in_hot) const
+	{
+		in_hot = false;
+		return m_size + charge <= m_max_size;
+	}
+
+	inline void Load(Entry* entry)
+	{
+		Insert(entry);
+	}
+
+	//小顶堆倒序遍历，近似按优先级从高到低
+	template<class Func>
+	void Foreach(const Func& func) const
+	{
+		for(size_t i = m_heap.size(); i > 0; --i)
+		{
+			func(m_heap[i - 1]);
+		}
+	}
+
+	void Stats(LruCacheStats& stats) const
+	{
+		stats.cold_size = m_size;
+		stats.cold_num = m_num;
+		stats.max_cold_size = m_max_size;
+	}
+
+private:
+	inline double Priority(const Entry* entry) const
+	{
+		return m_inflation + (double)entry->freq / MAX(entry->charge, (size_t)1);
+	}
+
+	inline void Place(Entry* entry, size_t i)
+	{
+		m_heap[i] = entry;
+		entry->heap_index = i;
+	}
+
+	void SiftUp(size_t i)
+	{
+		Entry* entry = m_heap[i];
+		while(i > 0)
+		{
+			size_t parent = (i - 1) / 2;
+			if(m_heap[parent]->priority <= entry->priority)
+			{
+				break;
+			}
+			Place(m_heap[parent], i);
+			i = parent;
+		}
+		Place(entry, i);
+	}
+
+	void SiftDown(size_t i)
+	{
+		Entry* entry = m_heap[i];
+		size_t num = m_heap.size();
+		for(;;)
+		{
+			size_t child = i * 2 + 1;
+			if(child >= num)
+			{
+				break;
+			}
+			if(child + 1 < num && m_heap[child + 1]->priority < m_heap[child]->priority)
+			{
+				++child;
+			}
+			if(entry->priority <= m_heap[child]->priority)
+			{
+				break;
+			}
+			Place(m_heap[child], i);
+			i = child;
+		}
+		Place(entry, i);
+	}
+
+private:
+	const size_t m_max_size;
+	double m_inflation;		//L
+
+	LruCounter m_size;
+	LruCounter m_num;
+	std::vector<Entry*> m_heap;
+
+private:
+	LruGdsfPolicy(const LruGdsfPolicy&) = delete;
+	LruGdsfPolicy& operator=(const LruGdsfPolicy&) = delete;
+};
+
+template<>
+struct LruPolicyLinkOf<LruGdsfPolicy>
+{
+	typedef LruGdsfLink Type;
+};
+
+}
+
+#endif
+
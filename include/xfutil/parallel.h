@@ -0,0 +1,313 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_parallel_h__
+#define __xfutil_parallel_h__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include "xfutil/types.h"
+#include "xfutil/futex.h"
+#include "xfutil/thread_pool.h"
+
+namespace xfutil
+{
+
+//grain为0时，每个线程平均分到的块数
+#define PARALLEL_CHUNKS_PER_THREAD	8
+
+//少于该数量时排序/归并不再拆分
+#define PARALLEL_SORT_GRAIN			4096
+#define PARALLEL_MERGE_GRAIN		8192
+
+/**[begin, end)按grain切块，调用者和线程池中的线程动态领取
+ * 状态由shared_ptr持有：调用者只等所有块执行完，不等尚未调度到的辅助任务
+ * grain大于区间长度时按区间长度算，块数和块边界的计算都不会溢出
+ */
+struct ParallelRange
+{
+	ParallelRange(size_t b, size_t e, size_t g)
+		: begin(b), end(e), grain(MIN(g, e - b)), next(0), finished(0), done(0)
+	{
+		size_t num = end - begin;
+		chunk_num = num / grain + ((num % grain != 0) ? 1 : 0);
+	}
+
+	//领取下一块，没有时返回false
+	inline bool Next(size_t& chunk, size_t& b, size_t& e)
+	{
+		chunk = next.fetch_add(1, std::memory_order_relaxed);
+		if(chunk >= chunk_num)
+		{
+			return false;
+		}
+		b = begin + chunk * grain;
+		e = (end - b > grain) ? b + grain : end;
+		return true;
+	}
+
+	//一块执行完，最后一块唤醒等待者
+	inline void Finish()
+	{
+		if(finished.fetch_add(1, std::memory_order_acq_rel) + 1 == chunk_num)
+		{
+			if(done.exchange(1, std::memory_order_acq_rel) == 2)
+			{
+				futex_wake(&done, INT_MAX);
+			}
+		}
+	}
+
+	size_t begin;
+	size_t end;
+	size_t grain;
+	size_t chunk_num;
+	std::atomic<size_t> next;
+	std::atomic<size_t> finished;
+	std::atomic<uint32_t> done;
+};
+
+static inline size_t ParallelGrain(ThreadPool& pool, size_t num, size_t grain)
+{
+	if(grain != 0)
+	{
+		return MIN(grain, num);
+	}
+	size_t thread_num = MAX(pool.Size(), (size_t)1);
+	return MAX(num / (thread_num * PARALLEL_CHUNKS_PER_THREAD), (size_t)1);
+}
+
+//辅助任务数：不超过线程数，也不超过除调用者领取外的块数
+static inline size_t ParallelHelperNum(ThreadPool& pool, size_t chunk_num)
+{
+	return MIN(pool.Size(), chunk_num - 1);
+}
+
+template<class F>
+struct ParallelForState : public ParallelRange
+{
+	ParallelForState(size_t b, size_t e, size_t g, const F& f)
+		: ParallelRange(b, e, g), func(f)
+	{}
+
+	void Run()
+	{
+		size_t chunk, b, e;
+		while(Next(chunk, b, e))
+		{
+			for(size_t i = b; i < e; ++i)
+			{
+				func(i);
+			}
+			Finish();
+		}
+	}
+
+	F func;
+};
+
+/**对[begin, end)中每个i并行调用func(i)，返回时全部执行完
+ * grain: 每块的个数，为0时按线程数自动计算
+ * func会被多个线程同时调用，需自行保证线程安全
+ */
+template<class F>
+void ParallelFor(ThreadPool& pool, size_t begin, size_t end, size_t grain, F func)
+{
+	if(begin >= end)
+	{
+		return;
+	}
+	grain = ParallelGrain(pool, end - begin, grain);
+
+	typedef ParallelForState<F> State;
+	std::shared_ptr<State> state = std::make_shared<State>(begin, end, grain, func);
+	size_t helper_num = ParallelHelperNum(pool, state->chunk_num);
+	for(size_t i = 0; i < helper_num; ++i)
+	{
+		pool.Submit([state]() { state->Run(); });
+	}
+	state->Run();
+	pool.Wait(state->done);
+}
+
+template<class F>
+inline void ParallelFor(size_t begin, size_t end, size_t grain, F func)
+{
+	ParallelFor(GetSharedThreadPool(), begin, end, grain, func);
+}
+
+template<typename T, class F, class Op>
+struct ParallelReduceState : public ParallelRange
+{
+	ParallelReduceState(size_t b, size_t e, size_t g, const T& init, const F& f, const Op& o)
+		: ParallelRange(b, e, g), results(chunk_num, init), identity(init), func(f), op(o)
+	{}
+
+	void Run()
+	{
+		size_t chunk, b, e;
+		while(Next(chunk, b, e))
+		{
+			T value = identity;
+			for(size_t i = b; i < e; ++i)
+			{
+				value = op(value, func(i));
+			}
+			results[chunk] = std::move(value);
+			Finish();
+		}
+	}
+
+	std::vector<T> results;
+	T identity;
+	F func;
+	Op op;
+};
+
+/**并行计算op(...op(op(identity, func(begin)), func(begin+1))..., func(end-1))
+ * 每块的结果按块的顺序合并，op只需满足结合律，结果与线程调度无关
+ * identity需是op的单位元，每块都从它开始
+ */
+template<typename T, class F, class Op>
+T ParallelReduce(ThreadPool& pool, size_t begin, size_t end, size_t grain, const T& identity, F func, Op op)
+{
+	if(begin >= end)
+	{
+		return identity;
+	}
+	grain = ParallelGrain(pool, end - begin, grain);
+
+	typedef ParallelReduceState<T, F, Op> State;
+	std::shared_ptr<State> state = std::make_shared<State>(begin, end, grain, identity, func, op);
+	size_t helper_num = ParallelHelperNum(pool, state->chunk_num);
+	for(size_t i = 0; i < helper_num; ++i)
+	{
+		pool.Submit([state]() { state->Run(); });
+	}
+	state->Run();
+	pool.Wait(state->done);
+
+	T result = identity;
+	for(size_t i = 0; i < state->results.size(); ++i)
+	{
+		result = op(result, state->results[i]);
+	}
+	return result;
+}
+
+template<typename T, class F, class Op>
+inline T ParallelReduce(size_t begin, size_t end, size_t grain, const T& identity, F func, Op op)
+{
+	return ParallelReduce(GetSharedThreadPool(), begin, end, grain, identity, func, op);
+}
+
+//把有序的[first1, last1)和[first2, last2)移动归并到out，大的一半取中值二分后并行归并两边
+template<class Iter, class OutIter, class Compare>
+void ParallelMerge(ThreadPool& pool, Iter first1, Iter last1, Iter first2, Iter last2, OutIter out, Compare comp)
+{
+	size_t len1 = last1 - first1;
+	size_t len2 = last2 - first2;
+	if(len1 + len2 <= PARALLEL_MERGE_GRAIN)
+	{
+		std::merge(std::make_move_iterator(first1), std::make_move_iterator(last1),
+			std::make_move_iterator(first2), std::make_move_iterator(last2), out, comp);
+		return;
+	}
+
+	if(len1 < len2)
+	{
+		std::swap(first1, first2);
+		std::swap(last1, last2);
+		std::swap(len1, len2);
+	}
+	Iter mid1 = first1 + len1 / 2;
+	Iter mid2 = std::lower_bound(first2, last2, *mid1, comp);
+	OutIter out_mid = out + (mid1 - first1) + (mid2 - first2);
+
+	TaskFuture<void> left = pool.Submit([&pool, first1, mid1, first2, mid2, out, comp]() {
+		ParallelMerge(pool, first1, mid1, first2, mid2, out, comp);
+	});
+	ParallelMerge(pool, mid1, last1, mid2, last2, out_mid, comp);
+	left.Wait();
+}
+
+//排序[first, last)，buf是同样长度的临时空间
+template<class Iter, class BufIter, class Compare>
+void ParallelSortImpl(ThreadPool& pool, Iter first, Iter last, BufIter buf, size_t grain, Compare comp)
+{
+	size_t num = last - first;
+	if(num <= grain)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	Iter mid = first + num / 2;
+	BufIter buf_mid = buf + num / 2;
+	TaskFuture<void> left = pool.Submit([&pool, first, mid, buf, grain, comp]() {
+		ParallelSortImpl(pool, first, mid, buf, grain, comp);
+	});
+	ParallelSortImpl(pool, mid, last, buf_mid, grain, comp);
+	left.Wait();
+
+	//归并到buf，再并行移回原位置
+	ParallelMerge(pool, first, mid, mid, last, buf, comp);
+	ParallelFor(pool, 0, num, PARALLEL_MERGE_GRAIN, [first, buf](size_t i) {
+		first[i] = std::move(buf[i]);
+	});
+}
+
+/**并行归并排序，不稳定
+ * 叶子用std::sort，归并也并行；需要与元素个数相同的临时空间，元素需可默认构造
+ */
+template<class Iter, class Compare>
+void ParallelSort(ThreadPool& pool, Iter first, Iter last, Compare comp)
+{
+	typedef typename std::iterator_traits<Iter>::value_type T;
+
+	size_t num = last - first;
+	size_t thread_num = MAX(pool.Size(), (size_t)1);
+	size_t grain = MAX(num / (thread_num * PARALLEL_CHUNKS_PER_THREAD), (size_t)PARALLEL_SORT_GRAIN);
+	if(num <= grain)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	std::vector<T> buf(num);
+	ParallelSortImpl(pool, first, last, buf.begin(), grain, comp);
+}
+
+template<class Iter, class Compare>
+inline void ParallelSort(Iter first, Iter last, Compare comp)
+{
+	ParallelSort(GetSharedThreadPool(), first, last, comp);
+}
+
+template<class Iter>
+inline void ParallelSort(Iter first, Iter last)
+{
+	ParallelSort(GetSharedThreadPool(), first, last, std::less<typename std::iterator_traits<Iter>::value_type>());
+}
+
+}
+
+#endif
+
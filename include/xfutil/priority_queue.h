@@ -0,0 +1,426 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_priority_queue_h__
+#define __xfutil_priority_queue_h__
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "xfutil/types.h"
+
+namespace xfutil
+{
+
+//容量为2的幂的环形缓冲区，满时扩容为2倍，不缩容；稳定运行后不再分配内存
+template<typename T>
+class RingBuffer
+{
+public:
+	RingBuffer() : m_head(0), m_size(0)
+	{}
+
+public:
+	inline size_t Size() const
+	{
+		return m_size;
+	}
+	inline bool Empty() const
+	{
+		return m_size == 0;
+	}
+
+	void Reserve(size_t num)
+	{
+		if(num > m_items.size())
+		{
+			Grow(num);
+		}
+	}
+
+	inline void PushBack(T&& v)
+	{
+		if(m_size == m_items.size())
+		{
+			Grow(m_size + 1);
+		}
+		m_items[(m_head + m_size) & (m_items.size() - 1)] = std::move(v);
+		++m_size;
+	}
+
+	inline void PopFront(T& v)
+	{
+		v = std::move(m_items[m_head]);
+		m_head = (m_head + 1) & (m_items.size() - 1);
+		--m_size;
+	}
+
+private:
+	void Grow(size_t num)
+	{
+		size_t capacity = MAX(m_items.size(), (size_t)16);
+		while(capacity < num)
+		{
+			capacity *= 2;
+		}
+
+		std::vector<T> items(capacity);
+		for(size_t i = 0; i < m_size; ++i)
+		{
+			items[i] = std::move(m_items[(m_head + i) & (m_items.size() - 1)]);
+		}
+		m_items.swap(items);
+		m_head = 0;
+	}
+
+private:
+	std::vector<T> m_items;
+	size_t m_head;
+	size_t m_size;
+};
+
+//固定LEVEL_NUM个优先级，0最高，同一优先级内FIFO
+template<typename T, uint32_t LEVEL_NUM>
+class PriorityStore
+{
+	static_assert(LEVEL_NUM > 0 && LEVEL_NUM <= 32, "LEVEL_NUM must be in [1, 32]");
+
+public:
+	typedef uint32_t Key;
+
+	PriorityStore() : m_size(0), m_mask(0)
+	{}
+
+public:
+	inline size_t Size() const
+	{
+		return m_size;
+	}
+
+	void Reserve(size_t num)
+	{
+		for(uint32_t i = 0; i < LEVEL_NUM; ++i)
+		{
+			m_levels[i].Reserve(num);
+		}
+	}
+
+	//超出范围的优先级按最低处理
+	inline void Push(T&& v, Key priority)
+	{
+		uint32_t level = MIN(priority, LEVEL_NUM - 1);
+		m_levels[level].PushBack(std::move(v));
+		m_mask |= (1U << level);
+		++m_size;
+	}
+
+	//非空的最高优先级由位图直接得到
+	inline void Pop(T& v)
+	{
+		uint32_t level = __builtin_ctz(m_mask);
+		m_levels[level].PopFront(v);
+		if(m_levels[level].Empty())
+		{
+			m_mask &= ~(1U << level);
+		}
+		--m_size;
+	}
+
+private:
+	RingBuffer<T> m_levels[LEVEL_NUM];
+	size_t m_size;
+	uint32_t m_mask;
+};
+
+//按截止时间最早优先(EDF)，截止时间相同的按入队顺序；二叉堆存放在vector中
+template<typename T>
+class DeadlineStore
+{
+public:
+	typedef uint64_t Key;
+
+	DeadlineStore() : m_seq(0)
+	{}
+
+public:
+	inline size_t Size() const
+	{
+		return m_heap.size();
+	}
+
+	void Reserve(size_t num)
+	{
+		m_heap.reserve(num);
+	}
+
+	inline void Push(T&& v, Key deadline)
+	{
+		m_heap.push_back(Item());
+		Item& item = m_heap.back();
+		item.deadline = deadline;
+		item.seq = m_seq++;
+		item.value = std::move(v);
+		std::push_heap(m_heap.begin(), m_heap.end(), Later);
+	}
+
+	inline void Pop(T& v)
+	{
+		std::pop_heap(m_heap.begin(), m_heap.end(), Later);
+		v = std::move(m_heap.back().value);
+		m_heap.pop_back();
+	}
+
+	//最早的截止时间，队列非空时调用
+	inline Key Front() const
+	{
+		return m_heap.front().deadline;
+	}
+
+private:
+	struct Item
+	{
+		uint64_t deadline;
+		uint64_t seq;
+		T value;
+	};
+
+	//std::push_heap建大顶堆，"更晚"作为小于，堆顶即最早
+	static inline bool Later(const Item& a, const Item& b)
+	{
+		return (a.deadline != b.deadline) ? (a.deadline > b.deadline) : (a.seq > b.seq);
+	}
+
+private:
+	std::vector<Item> m_heap;
+	uint64_t m_seq;
+};
+
+/**按Store的顺序出队的阻塞队列，阻塞和超时语义与BlockingQueue相同
+ * Store的存储只会增长，Reserve后或稳定运行后入队出队不分配内存
+ */
+template<typename T, class Store>
+class OrderedBlockingQueue
+{
+public:
+	typedef typename Store::Key Key;
+
+	explicit OrderedBlockingQueue(uint64_t capacity = (uint64_t)-1)
+		: m_capacity(capacity)
+	{}
+	~OrderedBlockingQueue()
+	{}
+
+public:
+	void SetCapacity(uint64_t capacity = (uint64_t)-1)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_capacity = capacity;
+	}
+	void Reserve(size_t num)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_store.Reserve(num);
+	}
+	size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_store.Size();
+	}
+
+	//只有数量限制
+	void Push(const T& v, Key key)
+	{
+		T tmp(v);
+		Push(std::move(tmp), key);
+	}
+	void Push(T&& v, Key key)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_store.Size() >= m_capacity)
+		{
+			m_not_full_cond.wait(lock);
+		}
+		m_store.Push(std::move(v), key);
+		m_not_empty_cond.notify_one();
+	}
+
+	bool Push(const T& v, Key key, uint32_t timeout_ms)
+	{
+		T tmp(v);
+		return Push(std::move(tmp), key, timeout_ms);
+	}
+	//超时返回false，此时v不被移走
+	bool Push(T&& v, Key key, uint32_t timeout_ms)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_store.Size() >= m_capacity)
+		{
+			if(m_not_full_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+			{
+				return false;
+			}
+		}
+		m_store.Push(std::move(v), key);
+		m_not_empty_cond.notify_one();
+		return true;
+	}
+
+	bool TryPush(const T& v, Key key)
+	{
+		T tmp(v);
+		return TryPush(std::move(tmp), key);
+	}
+	//满时返回false，此时v不被移走
+	bool TryPush(T&& v, Key key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_store.Size() >= m_capacity)
+		{
+			return false;
+		}
+		m_store.Push(std::move(v), key);
+		m_not_empty_cond.notify_one();
+		return true;
+	}
+
+	bool TryPop(T& v)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(m_store.Size() == 0)
+		{
+			return false;
+		}
+		m_store.Pop(v);
+		m_not_full_cond.notify_one();
+		return true;
+	}
+	void Pop(T& v)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_store.Size() == 0)
+		{
+			m_not_empty_cond.wait(lock);
+		}
+		m_store.Pop(v);
+		m_not_full_cond.notify_one();
+	}
+
+	bool Pop(T& v, uint32_t timeout_ms)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_store.Size() == 0)
+		{
+			if(m_not_empty_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+			{
+				return false;
+			}
+		}
+		m_store.Pop(v);
+		m_not_full_cond.notify_one();
+		return true;
+	}
+
+	/**按出队顺序最多取出max_num个追加到items，返回取出的数量
+	 * 队列为空时最多等待timeout_ms，超时返回0；timeout_ms为0时不等待
+	 */
+	size_t PopBatch(std::vector<T>& items, size_t max_num, uint32_t timeout_ms = (uint32_t)-1)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if(timeout_ms == (uint32_t)-1)
+		{
+			while(m_store.Size() == 0)
+			{
+				m_not_empty_cond.wait(lock);
+			}
+		}
+		else
+		{
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+			while(m_store.Size() == 0)
+			{
+				if(m_not_empty_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+				{
+					return 0;
+				}
+			}
+		}
+
+		size_t n = MIN(max_num, m_store.Size());
+		for(size_t i = 0; i < n; ++i)
+		{
+			items.push_back(T());
+			m_store.Pop(items.back());
+		}
+		if(n > 1)
+		{
+			m_not_full_cond.notify_all();
+		}
+		else if(n == 1)
+		{
+			m_not_full_cond.notify_one();
+		}
+		return n;
+	}
+
+protected:
+	mutable std::mutex m_mutex;
+	std::condition_variable m_not_empty_cond;
+	std::condition_variable m_not_full_cond;
+	Store m_store;
+	uint64_t m_capacity;
+
+private:
+	OrderedBlockingQueue(const OrderedBlockingQueue&) = delete;
+	OrderedBlockingQueue& operator=(const OrderedBlockingQueue&) = delete;
+};
+
+//LEVEL_NUM个优先级的阻塞队列，Push的key为优先级，0最高；严格按优先级出队，低优先级可能饥饿
+template<typename T, uint32_t LEVEL_NUM = 4>
+using PriorityBlockingQueue = OrderedBlockingQueue<T, PriorityStore<T, LEVEL_NUM>>;
+
+/**截止时间最早优先的阻塞队列，Push的key为截止时间（毫秒，建议用GetTickMilliTime()+时限）
+ * 出队不等待截止时间，只决定顺序；是否已过期由调用者判断
+ */
+template<typename T>
+class DeadlineBlockingQueue : public OrderedBlockingQueue<T, DeadlineStore<T>>
+{
+public:
+	explicit DeadlineBlockingQueue(uint64_t capacity = (uint64_t)-1)
+		: OrderedBlockingQueue<T, DeadlineStore<T>>(capacity)
+	{}
+
+public:
+	//最早的截止时间，队列为空时返回false
+	bool FrontDeadline(uint64_t& deadline)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		if(this->m_store.Size() == 0)
+		{
+			return false;
+		}
+		deadline = this->m_store.Front();
+		return true;
+	}
+};
+
+}
+
+#endif
+
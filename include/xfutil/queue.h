@@ -20,11 +20,177 @@ limitations under the License.
 #include <mutex>
 #include <condition_variable>
 #include <deque>
+#include <vector>
+#include <chrono>
+#include "xfutil/types.h"
 
 namespace xfutil
 {
 
-template <typename T>	
+//BlockingQueue的统计快照，时间单位为微秒
+struct QueueStatsSnapshot
+{
+	//驻留时间直方图：第i个桶为[2^i, 2^(i+1))微秒，第0个桶含小于1微秒，最后一个桶含更长的
+	static const int HISTOGRAM_SIZE = 26;
+
+	QueueStatsSnapshot()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+
+	uint64_t push_count;
+	uint64_t pop_count;
+	uint64_t push_wait_count;		//Push因队列满而等待的次数
+	uint64_t push_wait_time;		//Push因队列满而等待的总时间
+	uint64_t pop_wait_count;		//Pop因队列空而等待的次数
+	uint64_t pop_wait_time;			//Pop因队列空而等待的总时间
+	uint64_t size;
+	uint64_t high_water;			//队列长度的最大值
+	uint64_t elapsed_time;			//统计开始到快照的时间
+	uint64_t residence_histogram[HISTOGRAM_SIZE];	//入队到出队的时间
+
+	//每秒入队/出队数
+	inline double PushRate() const
+	{
+		return (elapsed_time != 0) ? push_count * 1000000.0 / elapsed_time : 0;
+	}
+	inline double PopRate() const
+	{
+		return (elapsed_time != 0) ? pop_count * 1000000.0 / elapsed_time : 0;
+	}
+
+	//驻留时间的percent分位数(0~100)，返回所在桶的上界
+	uint64_t ResidencePercentile(double percent) const
+	{
+		uint64_t total = 0;
+		for(int i = 0; i < HISTOGRAM_SIZE; ++i)
+		{
+			total += residence_histogram[i];
+		}
+		if(total == 0)
+		{
+			return 0;
+		}
+		uint64_t target = (uint64_t)(total * percent / 100);
+		uint64_t sum = 0;
+		for(int i = 0; i < HISTOGRAM_SIZE; ++i)
+		{
+			sum += residence_histogram[i];
+			if(sum > target || sum == total)
+			{
+				return 1ULL << (i + 1);
+			}
+		}
+		return 0;
+	}
+};
+
+//不统计，所有调用都是空函数，编译后没有开销
+class NoQueueStats
+{
+public:
+	inline uint64_t Now() const
+	{
+		return 0;
+	}
+	inline void OnPushWait(uint64_t /*start*/)
+	{}
+	inline void OnPopWait(uint64_t /*start*/)
+	{}
+	inline void OnPush(uint64_t /*now*/, size_t /*size*/)
+	{}
+	inline void OnPushFront(uint64_t /*now*/, size_t /*size*/)
+	{}
+	inline void OnPop(uint64_t /*now*/)
+	{}
+	inline void Snapshot(QueueStatsSnapshot& /*snapshot*/) const
+	{}
+	inline void Reset()
+	{}
+};
+
+/**统计等待时间、队列长度最大值、驻留时间分布和吞吐量
+ * 所有调用都在队列的锁内；每个元素额外记录入队时间
+ */
+class QueueStats
+{
+public:
+	QueueStats()
+	{
+		Reset();
+	}
+
+public:
+	inline uint64_t Now() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	inline void OnPushWait(uint64_t start)
+	{
+		++m_stats.push_wait_count;
+		m_stats.push_wait_time += Now() - start;
+	}
+	inline void OnPopWait(uint64_t start)
+	{
+		++m_stats.pop_wait_count;
+		m_stats.pop_wait_time += Now() - start;
+	}
+	inline void OnPush(uint64_t now, size_t size)
+	{
+		m_times.push_back(now);
+		Pushed(size);
+	}
+	inline void OnPushFront(uint64_t now, size_t size)
+	{
+		m_times.push_front(now);
+		Pushed(size);
+	}
+	inline void OnPop(uint64_t now)
+	{
+		uint64_t residence = now - m_times.front();
+		m_times.pop_front();
+		++m_stats.pop_count;
+
+		int index = (residence == 0) ? 0 : 63 - __builtin_clzll(residence);
+		++m_stats.residence_histogram[MIN(index, QueueStatsSnapshot::HISTOGRAM_SIZE - 1)];
+	}
+
+	inline void Snapshot(QueueStatsSnapshot& snapshot) const
+	{
+		snapshot = m_stats;
+		snapshot.size = m_times.size();
+		snapshot.elapsed_time = Now() - m_start_time;
+	}
+
+	//清零计数，队列中元素的入队时间保留
+	inline void Reset()
+	{
+		m_stats = QueueStatsSnapshot();
+		m_stats.high_water = m_times.size();
+		m_start_time = Now();
+	}
+
+private:
+	inline void Pushed(size_t size)
+	{
+		++m_stats.push_count;
+		if(size > m_stats.high_water)
+		{
+			m_stats.high_water = size;
+		}
+	}
+
+private:
+	QueueStatsSnapshot m_stats;
+	uint64_t m_start_time;
+	std::deque<uint64_t> m_times;
+};
+
+/**阻塞队列
+ * Stats: 统计策略，默认NoQueueStats不统计；需要观察是否成为瓶颈时用QueueStats，通过GetStats读取快照
+ */
+template <typename T, class Stats = NoQueueStats>
 class BlockingQueue
 {
 public:
@@ -50,23 +216,60 @@ public:
 	void Push(const T& v)
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		while(m_queue.size() >= m_capacity)
-		{
-			m_not_full_cond.wait(lock);
-		}
+		WaitNotFull(lock);
         m_queue.push_back(v);
+        m_stats.OnPush(m_stats.Now(), m_queue.size());
         m_not_empty_cond.notify_one();	
 	}
 
 	//只有数量限制
-	void PushFront(const T& v)
+	void Push(T&& v)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		WaitNotFull(lock);
+        m_queue.push_back(std::move(v));
+        m_stats.OnPush(m_stats.Now(), m_queue.size());
+        m_not_empty_cond.notify_one();	
+	}
+
+	//在队列中直接构造元素，只有数量限制
+	template<typename... Args>
+	void Emplace(Args&&... args)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		WaitNotFull(lock);
+        m_queue.emplace_back(std::forward<Args>(args)...);
+        m_stats.OnPush(m_stats.Now(), m_queue.size());
+        m_not_empty_cond.notify_one();	
+	}
+
+	//把items全部移入队列后清空items，容量不足时等待；每次加锁只notify一次
+	void PushBatch(std::vector<T>& items)
 	{
+		size_t i = 0;
 		std::unique_lock<std::mutex> lock(m_mutex);
-		while(m_queue.size() >= m_capacity)
+		while(i < items.size())
 		{
-			m_not_full_cond.wait(lock);
+			WaitNotFull(lock);
+			uint64_t now = m_stats.Now();
+			size_t n = 0;
+			for(; i < items.size() && m_queue.size() < m_capacity; ++i, ++n)
+			{
+				m_queue.push_back(std::move(items[i]));
+				m_stats.OnPush(now, m_queue.size());
+			}
+			Notify(m_not_empty_cond, n);
 		}
+		items.clear();
+	}
+
+	//只有数量限制
+	void PushFront(const T& v)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		WaitNotFull(lock);
         m_queue.push_front(v);
+        m_stats.OnPushFront(m_stats.Now(), m_queue.size());
         m_not_empty_cond.notify_one();	
 	}
 
@@ -74,14 +277,21 @@ public:
 	bool Push(const T& v, uint32_t timeout_ms)
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		while(m_queue.size() >= m_capacity)
+		if(m_queue.size() >= m_capacity)
 		{
-			if(m_not_full_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms)) == std::cv_status::timeout)
+			uint64_t start = m_stats.Now();
+			while(m_queue.size() >= m_capacity)
 			{
-				return false;
+				if(m_not_full_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms)) == std::cv_status::timeout)
+				{
+					m_stats.OnPushWait(start);
+					return false;
+				}
 			}
+			m_stats.OnPushWait(start);
 		}
 		m_queue.push_back(v);
+		m_stats.OnPush(m_stats.Now(), m_queue.size());
 		m_not_empty_cond.notify_one();	
 		return true;
 	}
@@ -94,6 +304,7 @@ public:
 			return false;
 		}
         m_queue.push_back(v);
+        m_stats.OnPush(m_stats.Now(), m_queue.size());
         m_not_empty_cond.notify_one();
         return true;
 	}	
@@ -105,49 +316,150 @@ public:
 		{
 			return false;
 		}
-        v = m_queue.front();
+        v = std::move(m_queue.front());
         m_queue.pop_front();
+        m_stats.OnPop(m_stats.Now());
         m_not_full_cond.notify_one();
         return true;			
 	}
 	void Pop(T& v)
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		while(m_queue.empty())
+		if(m_queue.empty())
 		{
-			m_not_empty_cond.wait(lock);
+			uint64_t start = m_stats.Now();
+			while(m_queue.empty())
+			{
+				m_not_empty_cond.wait(lock);
+			}
+			m_stats.OnPopWait(start);
 		}
-        v = m_queue.front();
+        v = std::move(m_queue.front());
         m_queue.pop_front();
+        m_stats.OnPop(m_stats.Now());
         m_not_full_cond.notify_one();			
 	}
 	
 	bool Pop(T& v, uint32_t timeout_ms)
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		while(m_queue.empty())
+		if(m_queue.empty())
 		{
-			if(m_not_empty_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms)) == std::cv_status::timeout)
+			uint64_t start = m_stats.Now();
+			while(m_queue.empty())
 			{
-				return false;
+				if(m_not_empty_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms)) == std::cv_status::timeout)
+				{
+					m_stats.OnPopWait(start);
+					return false;
+				}
 			}
+			m_stats.OnPopWait(start);
 		}
-        v = m_queue.front();
+        v = std::move(m_queue.front());
         m_queue.pop_front();
+        m_stats.OnPop(m_stats.Now());
         m_not_full_cond.notify_one();
         return true;
 	}
+
+	/**最多取出max_num个追加到items，返回取出的数量
+	 * 队列为空时最多等待timeout_ms，超时返回0；timeout_ms为0时不等待
+	 */
+	size_t PopBatch(std::vector<T>& items, size_t max_num, uint32_t timeout_ms = (uint32_t)-1)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if(m_queue.empty() && timeout_ms != 0)
+		{
+			uint64_t start = m_stats.Now();
+			if(timeout_ms == (uint32_t)-1)
+			{
+				while(m_queue.empty())
+				{
+					m_not_empty_cond.wait(lock);
+				}
+			}
+			else
+			{
+				std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+				while(m_queue.empty())
+				{
+					if(m_not_empty_cond.wait_until(lock, deadline) == std::cv_status::timeout)
+					{
+						m_stats.OnPopWait(start);
+						return 0;
+					}
+				}
+			}
+			m_stats.OnPopWait(start);
+		}
+
+		uint64_t now = m_stats.Now();
+		size_t n = MIN(max_num, m_queue.size());
+		for(size_t i = 0; i < n; ++i)
+		{
+			items.push_back(std::move(m_queue.front()));
+			m_queue.pop_front();
+			m_stats.OnPop(now);
+		}
+		Notify(m_not_full_cond, n);
+		return n;
+	}
+
+	//统计快照，Stats为NoQueueStats时只有size
+	QueueStatsSnapshot GetStats()
+	{
+		QueueStatsSnapshot snapshot;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.Snapshot(snapshot);
+		snapshot.size = m_queue.size();
+		return snapshot;
+	}
+
+	void ResetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.Reset();
+	}
 	
+private:
+	//队列满时等待，记录等待时间
+	inline void WaitNotFull(std::unique_lock<std::mutex>& lock)
+	{
+		if(m_queue.size() >= m_capacity)
+		{
+			uint64_t start = m_stats.Now();
+			while(m_queue.size() >= m_capacity)
+			{
+				m_not_full_cond.wait(lock);
+			}
+			m_stats.OnPushWait(start);
+		}
+	}
+
+	inline void Notify(std::condition_variable& cond, size_t n)
+	{
+		if(n > 1)
+		{
+			cond.notify_all();
+		}
+		else if(n == 1)
+		{
+			cond.notify_one();
+		}
+	}
+
 private:
     mutable std::mutex m_mutex;
     std::condition_variable m_not_empty_cond;
     std::condition_variable m_not_full_cond;
     std::deque<T> m_queue;
     uint64_t m_capacity;
+    Stats m_stats;
     	
 private:
-    BlockingQueue(const BlockingQueue<T>& other) = delete;
-    BlockingQueue<T>& operator=(const BlockingQueue<T>& other) = delete;
+    BlockingQueue(const BlockingQueue& other) = delete;
+    BlockingQueue& operator=(const BlockingQueue& other) = delete;
 		
 };
 
@@ -0,0 +1,624 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_ring_queue_h__
+#define __xfutil_ring_queue_h__
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <utility>
+#include "xfutil/types.h"
+#include "xfutil/futex.h"
+
+namespace xfutil
+{
+
+#define RING_CACHELINE_SIZE		64
+
+/**有界多生产者多消费者队列，接口与BlockingQueue相同（容量固定，没有PushFront）
+ * 每个slot带序号：seq==pos表示可写，seq==pos+1表示可读，读写只需CAS各自的位置
+ * 只有队列满/空时才加锁等待，有等待者时才notify
+ */
+template <typename T>
+class RingQueue
+{
+public:
+	//capacity向上取整到2的幂
+	explicit RingQueue(size_t capacity)
+	{
+		size_t num = 2;
+		while(num < capacity)
+		{
+			num <<= 1;
+		}
+		m_cells = new Cell[num];
+		for(size_t i = 0; i < num; ++i)
+		{
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+		m_mask = num - 1;
+
+		m_push_pos.store(0, std::memory_order_relaxed);
+		m_pop_pos.store(0, std::memory_order_relaxed);
+		m_push_waiters.store(0, std::memory_order_relaxed);
+		m_pop_waiters.store(0, std::memory_order_relaxed);
+	}
+	~RingQueue()
+	{
+		delete[] m_cells;
+	}
+
+public:
+	inline size_t Capacity() const
+	{
+		return m_mask + 1;
+	}
+
+	//并发修改时是近似值
+	size_t Size() const
+	{
+		size_t pop_pos = m_pop_pos.load(std::memory_order_relaxed);
+		size_t push_pos = m_push_pos.load(std::memory_order_relaxed);
+		return (push_pos > pop_pos) ? push_pos - pop_pos : 0;
+	}
+
+	void Push(const T& v)
+	{
+		if(!TryPush(v))
+		{
+			WaitPush(v, nullptr);
+		}
+	}
+
+	bool Push(const T& v, uint32_t timeout_ms)
+	{
+		if(TryPush(v))
+		{
+			return true;
+		}
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		return WaitPush(v, &deadline);
+	}
+
+	bool TryPush(const T& v)
+	{
+		if(!Push_(v))
+		{
+			return false;
+		}
+		Notify(m_pop_waiters, m_not_empty_cond);
+		return true;
+	}
+
+	//移动版本：只有写入成功时v才被移走，失败或超时时v保持不变
+	void Push(T&& v)
+	{
+		if(!TryPush(std::move(v)))
+		{
+			WaitPush(std::move(v), nullptr);
+		}
+	}
+
+	bool Push(T&& v, uint32_t timeout_ms)
+	{
+		if(TryPush(std::move(v)))
+		{
+			return true;
+		}
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		return WaitPush(std::move(v), &deadline);
+	}
+
+	bool TryPush(T&& v)
+	{
+		if(!Push_(std::move(v)))
+		{
+			return false;
+		}
+		Notify(m_pop_waiters, m_not_empty_cond);
+		return true;
+	}
+
+	bool TryPop(T& v)
+	{
+		if(!Pop_(v))
+		{
+			return false;
+		}
+		Notify(m_push_waiters, m_not_full_cond);
+		return true;
+	}
+
+	void Pop(T& v)
+	{
+		if(!TryPop(v))
+		{
+			WaitPop(v, nullptr);
+		}
+	}
+
+	bool Pop(T& v, uint32_t timeout_ms)
+	{
+		if(TryPop(v))
+		{
+			return true;
+		}
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		return WaitPop(v, &deadline);
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	//不唤醒等待者；满时不访问v
+	template<typename U>
+	bool Push_(U&& v)
+	{
+		Cell* cell;
+		size_t pos = m_push_pos.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if(diff == 0)
+			{
+				if(m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if(diff < 0)
+			{
+				return false;	//满
+			}
+			else
+			{
+				pos = m_push_pos.load(std::memory_order_relaxed);
+			}
+		}
+		cell->data = std::forward<U>(v);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop_(T& v)
+	{
+		Cell* cell;
+		size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if(diff == 0)
+			{
+				if(m_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if(diff < 0)
+			{
+				return false;	//空
+			}
+			else
+			{
+				pos = m_pop_pos.load(std::memory_order_relaxed);
+			}
+		}
+		v = std::move(cell->data);
+		cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	//先登记等待者再检查队列，与Notify中先修改队列再检查等待者配对，不会丢失唤醒
+	//v只在写入成功的那一次被转发，之前失败的尝试不会移走它
+	template<typename U>
+	bool WaitPush(U&& v, const std::chrono::steady_clock::time_point* deadline)
+	{
+		for(uint32_t i = 0; i < SPIN_NUM; ++i)
+		{
+			if(TryPush(std::forward<U>(v)))
+			{
+				return true;
+			}
+		}
+
+		m_push_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		bool ok = true;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while(!Push_(std::forward<U>(v)))
+			{
+				if(deadline == nullptr)
+				{
+					m_not_full_cond.wait(lock);
+				}
+				else if(m_not_full_cond.wait_until(lock, *deadline) == std::cv_status::timeout)
+				{
+					ok = Push_(std::forward<U>(v));
+					break;
+				}
+			}
+		}
+		m_push_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+		//Notify需要加锁，在释放锁后进行
+		if(ok)
+		{
+			Notify(m_pop_waiters, m_not_empty_cond);
+		}
+		return ok;
+	}
+
+	bool WaitPop(T& v, const std::chrono::steady_clock::time_point* deadline)
+	{
+		for(uint32_t i = 0; i < SPIN_NUM; ++i)
+		{
+			if(TryPop(v))
+			{
+				return true;
+			}
+		}
+
+		m_pop_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		bool ok = true;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while(!Pop_(v))
+			{
+				if(deadline == nullptr)
+				{
+					m_not_empty_cond.wait(lock);
+				}
+				else if(m_not_empty_cond.wait_until(lock, *deadline) == std::cv_status::timeout)
+				{
+					ok = Pop_(v);
+					break;
+				}
+			}
+		}
+		m_pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+		//Notify需要加锁，在释放锁后进行
+		if(ok)
+		{
+			Notify(m_push_waiters, m_not_full_cond);
+		}
+		return ok;
+	}
+
+	//加锁后再notify，保证等待者已进入wait或还未检查队列
+	inline void Notify(const std::atomic<uint32_t>& waiters, std::condition_variable& cond)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(waiters.load(std::memory_order_relaxed) != 0)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			cond.notify_one();
+		}
+	}
+
+private:
+	static const uint32_t SPIN_NUM = 64;
+
+	Cell* m_cells;
+	size_t m_mask;
+
+	//生产者和消费者的位置放在不同的cache line上
+	char m_pad0[RING_CACHELINE_SIZE];
+	std::atomic<size_t> m_push_pos;
+	char m_pad1[RING_CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_pop_pos;
+	char m_pad2[RING_CACHELINE_SIZE - sizeof(std::atomic<size_t>)];
+
+	std::atomic<uint32_t> m_push_waiters;
+	std::atomic<uint32_t> m_pop_waiters;
+	std::mutex m_mutex;
+	std::condition_variable m_not_full_cond;
+	std::condition_variable m_not_empty_cond;
+
+private:
+	RingQueue(const RingQueue&) = delete;
+	RingQueue& operator=(const RingQueue&) = delete;
+};
+
+/**单生产者单消费者队列：Push类接口只能由一个线程调用，Pop类接口只能由另一个线程调用
+ * 双方各自缓存对方的位置，只有按缓存的位置判断为满/空时才读取对方的cache line
+ * TryPush/TryPop/PushBatch/PopBatch不阻塞；Push/Pop在满/空时用futex睡眠，对方只在有等待者时唤醒
+ */
+template <typename T>
+class SpscRingQueue
+{
+public:
+	//capacity向上取整到2的幂
+	explicit SpscRingQueue(size_t capacity)
+	{
+		size_t num = 2;
+		while(num < capacity)
+		{
+			num <<= 1;
+		}
+		m_cells = new T[num];
+		m_mask = num - 1;
+
+		m_tail.store(0, std::memory_order_relaxed);
+		m_cached_head = 0;
+		m_head.store(0, std::memory_order_relaxed);
+		m_cached_tail = 0;
+		m_push_waiting.store(0, std::memory_order_relaxed);
+		m_pop_waiting.store(0, std::memory_order_relaxed);
+	}
+	~SpscRingQueue()
+	{
+		delete[] m_cells;
+	}
+
+public:
+	inline size_t Capacity() const
+	{
+		return m_mask + 1;
+	}
+
+	//并发修改时是近似值
+	size_t Size() const
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		return (tail > head) ? tail - head : 0;
+	}
+
+	inline bool TryPush(const T& v)
+	{
+		return PushBatch(&v, 1) == 1;
+	}
+
+	//移动版本：只有写入成功时v才被移走
+	inline bool TryPush(T&& v)
+	{
+		return PushBatchMove(&v, 1) == 1;
+	}
+
+	inline bool TryPop(T& v)
+	{
+		return PopBatch(&v, 1) == 1;
+	}
+
+	//最多写入num个，返回实际写入的数量
+	inline size_t PushBatch(const T* items, size_t num)
+	{
+		return PushBatch_(items, num);
+	}
+
+	//同PushBatch，但移动items中的元素：前返回值个被移走，其余保持不变
+	inline size_t PushBatchMove(T* items, size_t num)
+	{
+		return PushBatch_(std::make_move_iterator(items), num);
+	}
+
+	//最多读出max_num个，返回实际读出的数量；元素从队列中移出
+	size_t PopBatch(T* items, size_t max_num)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		size_t num = m_cached_tail - head;
+		if(num < max_num)
+		{
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+			num = m_cached_tail - head;
+		}
+		num = MIN(num, max_num);
+		if(num == 0)
+		{
+			return 0;
+		}
+
+		for(size_t i = 0; i < num; ++i)
+		{
+			items[i] = std::move(m_cells[(head + i) & m_mask]);
+		}
+		m_head.store(head + num, std::memory_order_release);
+
+		Wake(m_push_waiting);
+		return num;
+	}
+
+	void Push(const T& v)
+	{
+		while(!TryPush(v))
+		{
+			Wait(m_push_waiting, &SpscRingQueue::CanPush, nullptr);
+		}
+	}
+
+	bool Push(const T& v, uint32_t timeout_ms)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while(!TryPush(v))
+		{
+			if(!Wait(m_push_waiting, &SpscRingQueue::CanPush, &deadline))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//移动版本：超时时v保持不变
+	void Push(T&& v)
+	{
+		while(!TryPush(std::move(v)))
+		{
+			Wait(m_push_waiting, &SpscRingQueue::CanPush, nullptr);
+		}
+	}
+
+	bool Push(T&& v, uint32_t timeout_ms)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while(!TryPush(std::move(v)))
+		{
+			if(!Wait(m_push_waiting, &SpscRingQueue::CanPush, &deadline))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Pop(T& v)
+	{
+		while(!TryPop(v))
+		{
+			Wait(m_pop_waiting, &SpscRingQueue::CanPop, nullptr);
+		}
+	}
+
+	bool Pop(T& v, uint32_t timeout_ms)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while(!TryPop(v))
+		{
+			if(!Wait(m_pop_waiting, &SpscRingQueue::CanPop, &deadline))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	//items为指针或move_iterator，决定复制还是移动
+	template<typename Iter>
+	size_t PushBatch_(Iter items, size_t num)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t free_num = m_cached_head + m_mask + 1 - tail;
+		if(free_num < num)
+		{
+			m_cached_head = m_head.load(std::memory_order_acquire);
+			free_num = m_cached_head + m_mask + 1 - tail;
+		}
+		num = MIN(num, free_num);
+		if(num == 0)
+		{
+			return 0;
+		}
+
+		for(size_t i = 0; i < num; ++i)
+		{
+			m_cells[(tail + i) & m_mask] = items[i];
+		}
+		m_tail.store(tail + num, std::memory_order_release);
+
+		Wake(m_pop_waiting);
+		return num;
+	}
+
+	inline bool CanPush() const
+	{
+		return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_acquire) <= m_mask;
+	}
+
+	inline bool CanPop() const
+	{
+		return m_tail.load(std::memory_order_acquire) != m_head.load(std::memory_order_relaxed);
+	}
+
+	//先置等待标志再检查，与Wake中先修改位置再检查标志配对，不会丢失唤醒；超时返回false
+	bool Wait(std::atomic<uint32_t>& waiting, bool (SpscRingQueue::*ready)() const, 
+			const std::chrono::steady_clock::time_point* deadline)
+	{
+		for(uint32_t i = 0; i < SPIN_NUM; ++i)
+		{
+			if((this->*ready)())
+			{
+				return true;
+			}
+		}
+
+		for(;;)
+		{
+			waiting.store(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if((this->*ready)())
+			{
+				waiting.store(0, std::memory_order_relaxed);
+				return true;
+			}
+
+			int timeout_ms = -1;
+			if(deadline != nullptr)
+			{
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				if(now >= *deadline)
+				{
+					waiting.store(0, std::memory_order_relaxed);
+					return false;
+				}
+				timeout_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - now).count() + 1;
+			}
+			futex_wait(&waiting, 1, timeout_ms);
+		}
+	}
+
+	inline void Wake(std::atomic<uint32_t>& waiting)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(waiting.load(std::memory_order_relaxed) != 0)
+		{
+			waiting.store(0, std::memory_order_relaxed);
+			futex_wake(&waiting, 1);
+		}
+	}
+
+private:
+	static const uint32_t SPIN_NUM = 64;
+
+	T* m_cells;
+	size_t m_mask;
+
+	//生产者写、消费者写、双方很少写的部分各占一个cache line
+	char m_pad0[RING_CACHELINE_SIZE];
+	std::atomic<size_t> m_tail;
+	size_t m_cached_head;
+	char m_pad1[RING_CACHELINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	std::atomic<size_t> m_head;
+	size_t m_cached_tail;
+	char m_pad2[RING_CACHELINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	std::atomic<uint32_t> m_push_waiting;
+	std::atomic<uint32_t> m_pop_waiting;
+	char m_pad3[RING_CACHELINE_SIZE - 2 * sizeof(std::atomic<uint32_t>)];
+
+private:
+	SpscRingQueue(const SpscRingQueue&) = delete;
+	SpscRingQueue& operator=(const SpscRingQueue&) = delete;
+};
+
+}
+
+#endif
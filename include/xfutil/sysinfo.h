@@ -18,6 +18,9 @@ limitations under the License.
 #define __xfutil_sysinfo_h__
 
 #include <thread>
+#include <vector>
+#include <unistd.h>
+#include "xfutil/types.h"
 
 namespace xfutil 
 {
@@ -41,6 +44,18 @@ public:
     {
         return (uint64_t)sysconf(_SC_PHYS_PAGES) * GetPageSize();
     }
+
+    //NUMA节点数，无法获取时视为1个节点
+    static uint32_t GetNumaNodeNum();
+
+    //第index个NUMA节点(按节点号从小到大)的CPU列表
+    static bool GetNumaNodeCpus(uint32_t index, std::vector<int>& cpus);
+
+    //cpu所在NUMA节点的下标，未知时返回0
+    static uint32_t GetCpuNumaNode(int cpu);
+
+    //解析sysfs中"0-3,8,10-11"格式的CPU列表
+    static bool ParseCpuList(const char* str, std::vector<int>& cpus);
 #else
 
 #endif
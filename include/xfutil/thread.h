@@ -20,6 +20,7 @@ limitations under the License.
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <string>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -30,6 +31,17 @@ namespace xfutil
 
 typedef void (*ThreadFunc)(void* arg);	
 
+//线程启动选项，在线程函数执行前设置，设置失败时忽略
+struct ThreadOptions
+{
+	//线程名，用于top/perf等工具；ThreadGroup中为"name-下标"，超过15字节截断
+	std::string name;
+	//绑定的CPU列表，为空时不绑定
+	std::vector<int> cpus;
+	//ThreadGroup中第i个线程绑定到第i%节点数个NUMA节点的CPU，cpus非空或只有一个节点时忽略
+	bool numa_spread = false;
+};
+
 class Thread
 {
 public:
@@ -43,6 +55,8 @@ public:
 		m_thread.swap(t);
         return true;
 	}
+	bool Start(ThreadFunc func, void* arg, const ThreadOptions& options);
+
 	void Detach()
 	{
 		m_thread.detach();
@@ -64,6 +78,15 @@ public:
 	{
 		return syscall(SYS_gettid);
 	}
+
+	//设置当前线程名
+	static bool SetName(const char* name);
+
+	//当前线程绑定到cpus
+	static bool SetAffinity(const std::vector<int>& cpus);
+
+	//当前线程绑定到第index个NUMA节点中当前亲和性允许的CPU，没有允许的CPU时返回false
+	static bool BindNumaNode(uint32_t index);
 	
 private:
 	std::thread m_thread;
@@ -84,6 +107,7 @@ public:
 		
 public:
 	void Start(int thread_count, GThreadFunc func, void* arg = nullptr);
+	void Start(int thread_count, GThreadFunc func, void* arg, const ThreadOptions& options);
 	void Detach();
 	void Join();
 	inline size_t Size()
@@ -0,0 +1,305 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_thread_pool_h__
+#define __xfutil_thread_pool_h__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <climits>
+#include <type_traits>
+#include "xfutil/types.h"
+#include "xfutil/futex.h"
+#include "xfutil/thread.h"
+#include "xfutil/ring_queue.h"
+
+namespace xfutil
+{
+
+//线程池中的任务，执行后由线程池delete
+struct PoolTask
+{
+	virtual ~PoolTask()
+	{}
+	virtual void Run() = 0;
+};
+
+/**Chase-Lev工作窃取双端队列
+ * 所属线程在bottom端Push/Pop（LIFO），其他线程在top端Steal（FIFO）
+ * 满时扩容为2倍，旧数组可能仍被窃取者读取，析构时才释放
+ */
+class TaskDeque
+{
+public:
+	TaskDeque();
+	~TaskDeque();
+
+public:
+	//只能由所属线程调用
+	void Push(PoolTask* task);
+	PoolTask* Pop();
+
+	//任意线程调用，冲突时返回nullptr
+	PoolTask* Steal();
+
+	inline bool Empty() const
+	{
+		return m_bottom.load(std::memory_order_acquire) <= m_top.load(std::memory_order_acquire);
+	}
+
+private:
+	struct Array
+	{
+		int64_t capacity;
+		std::atomic<PoolTask*>* tasks;
+		Array* prev;
+
+		inline PoolTask* Get(int64_t i) const
+		{
+			return tasks[i & (capacity - 1)].load(std::memory_order_relaxed);
+		}
+		inline void Put(int64_t i, PoolTask* task)
+		{
+			tasks[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+		}
+	};
+
+	static Array* NewArray(int64_t capacity, Array* prev);
+	Array* Grow(Array* array, int64_t bottom, int64_t top);
+
+private:
+	static const int64_t INIT_CAPACITY = 256;
+
+	char m_pad0[RING_CACHELINE_SIZE];
+	std::atomic<int64_t> m_top;
+	char m_pad1[RING_CACHELINE_SIZE - sizeof(std::atomic<int64_t>)];
+	std::atomic<int64_t> m_bottom;
+	std::atomic<Array*> m_array;
+	char m_pad2[RING_CACHELINE_SIZE - sizeof(std::atomic<int64_t>) - sizeof(std::atomic<Array*>)];
+
+private:
+	TaskDeque(const TaskDeque&) = delete;
+	TaskDeque& operator=(const TaskDeque&) = delete;
+};
+
+//done: 0未完成，1已完成，2未完成且有等待者在futex上睡眠
+template<typename R>
+struct PoolTaskResult
+{
+	template<class F>
+	inline void Run(F& func)
+	{
+		value.reset(new R(func()));
+	}
+	inline R& Get()
+	{
+		return *value;
+	}
+
+	std::unique_ptr<R> value;
+};
+
+template<>
+struct PoolTaskResult<void>
+{
+	template<class F>
+	inline void Run(F& func)
+	{
+		func();
+	}
+	inline void Get()
+	{}
+};
+
+template<typename R>
+struct PoolTaskState : public PoolTaskResult<R>
+{
+	PoolTaskState() : done(0)
+	{}
+
+	std::atomic<uint32_t> done;
+};
+
+template<class F, typename R>
+struct PoolFuncTask : public PoolTask
+{
+	PoolFuncTask(F&& f, const std::shared_ptr<PoolTaskState<R>>& s)
+		: func(std::move(f)), state(s)
+	{}
+
+	virtual void Run()
+	{
+		state->Run(func);
+		if(state->done.exchange(1, std::memory_order_acq_rel) == 2)
+		{
+			futex_wake(&state->done, INT_MAX);
+		}
+	}
+
+	F func;
+	std::shared_ptr<PoolTaskState<R>> state;
+};
+
+class ThreadPool;
+
+//Submit返回的句柄，Get等待任务完成并返回结果
+//在线程池的工作线程中等待时，会先执行其他任务而不是阻塞
+template<typename R>
+class TaskFuture
+{
+public:
+	TaskFuture() : m_pool(nullptr)
+	{}
+	TaskFuture(ThreadPool* pool, const std::shared_ptr<PoolTaskState<R>>& state)
+		: m_pool(pool), m_state(state)
+	{}
+
+public:
+	inline bool Valid() const
+	{
+		return (bool)m_state;
+	}
+
+	inline bool IsReady() const
+	{
+		return m_state->done.load(std::memory_order_acquire) == 1;
+	}
+
+	void Wait();
+
+	typename std::add_lvalue_reference<R>::type Get()
+	{
+		Wait();
+		return m_state->Get();
+	}
+
+private:
+	ThreadPool* m_pool;
+	std::shared_ptr<PoolTaskState<R>> m_state;
+};
+
+/**工作窃取线程池
+ * 每个工作线程有自己的TaskDeque，工作线程中Submit的任务压入自己的deque；
+ * 外部线程Submit的任务进入无锁的RingQueue，满时等待
+ * 空闲线程先从其他线程随机窃取，多次找不到任务后在futex上睡眠，有空闲线程时Submit才唤醒
+ */
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+public:
+	/**启动线程池
+	 * thread_count: 线程数，<0时为-thread_count*CPU个数
+	 * queue_capacity: 外部线程提交任务的队列容量
+	 * options: 线程名、CPU绑定和NUMA分布
+	 */
+	bool Start(int thread_count = -1, size_t queue_capacity = 4096, const ThreadOptions& options = ThreadOptions());
+
+	//等待已提交的任务执行完后停止，开始停止后Submit的任务在提交者线程直接执行
+	//在本线程池的工作线程中调用时直接返回，由其他线程或析构停止
+	void Stop();
+
+	inline size_t Size() const
+	{
+		return m_workers.size();
+	}
+
+	//未启动或正在停止时在当前线程直接执行
+	template<class F>
+	auto Submit(F func) -> TaskFuture<decltype(func())>
+	{
+		typedef decltype(func()) R;
+		std::shared_ptr<PoolTaskState<R>> state = std::make_shared<PoolTaskState<R>>();
+		PoolTask* task = new PoolFuncTask<F, R>(std::move(func), state);
+		if(!TryPush(task))
+		{
+			task->Run();
+			delete task;
+		}
+		return TaskFuture<R>(this, state);
+	}
+
+	//当前线程是本线程池的工作线程时返回其下标，否则返回-1
+	int WorkerIndex() const;
+
+	//等待done变为1，工作线程会执行其他任务
+	void Wait(std::atomic<uint32_t>& done);
+
+private:
+	struct Worker
+	{
+		TaskDeque deque;
+		uint64_t seed;
+	};
+
+	//线程池运行中时放入任务，否则返回false
+	bool TryPush(PoolTask* task);
+	void Push(PoolTask* task);
+	PoolTask* FindTask(Worker* worker);
+	bool HasTask() const;
+	void Park();
+	void Notify();
+
+	static void WorkerFunc(int index, void* arg);
+	void Work(int index);
+
+private:
+	static const uint32_t SPIN_NUM = 64;
+
+	enum
+	{
+		STATE_STOPPED = 0,
+		STATE_RUNNING,
+		STATE_STOPPING,
+	};
+
+	std::atomic<int> m_state;
+	std::atomic<uint32_t> m_push_num;		//正在TryPush的外部线程数，Stop等它归0后才让工作线程退出
+	std::atomic<bool> m_stopping;
+	std::vector<Worker*> m_workers;
+	std::unique_ptr<RingQueue<PoolTask*>> m_queue;
+	ThreadGroup m_threads;
+
+	std::atomic<uint32_t> m_idle_num;
+	std::atomic<uint32_t> m_wake_epoch;
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+};
+
+//进程内共享的线程池，首次调用时按CPU个数启动，默认不绑定CPU
+ThreadPool& GetSharedThreadPool();
+
+//设置共享线程池的启动选项（如numa_spread），必须在首次GetSharedThreadPool前调用
+void SetSharedThreadPoolOptions(const ThreadOptions& options);
+
+template<typename R>
+void TaskFuture<R>::Wait()
+{
+	if(m_state->done.load(std::memory_order_acquire) != 1)
+	{
+		m_pool->Wait(m_state->done);
+	}
+}
+
+}
+
+#endif
+
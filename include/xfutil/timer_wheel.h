@@ -0,0 +1,153 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#ifndef __xfutil_timer_wheel_h__
+#define __xfutil_timer_wheel_h__
+
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include "xfutil/types.h"
+#include "xfutil/list.h"
+#include "xfutil/time.h"
+#include "xfutil/thread.h"
+#include "xfutil/thread_pool.h"
+
+namespace xfutil
+{
+
+typedef void (*TimerCallback)(uint64_t timer_id, void* arg);
+
+/**分层时间轮，精度1毫秒，时钟为GetTickMilliTime()
+ * 第0层256个槽，其余4层各64个槽，最长约49天，更长的延时按最长处理
+ * 定时器节点分块分配并复用，Schedule/Cancel为O(1)，定时器id带代数，过期id不会误删新定时器
+ * 可以Start启动一个线程驱动，也可以在调用者的事件循环中用NextTimeout/Advance驱动
+ * 回调在锁外执行：未指定线程池时在驱动线程中执行，否则提交到线程池
+ */
+class TimerWheel
+{
+public:
+	explicit TimerWheel(ThreadPool* pool = nullptr);
+	~TimerWheel();
+
+public:
+	/**delay_ms后执行cb(timer_id, arg)
+	 * interval_ms: 非0时为周期定时器，每隔interval_ms执行一次直到Cancel，错过的周期不补
+	 * 返回定时器id，不会为0
+	 */
+	uint64_t Schedule(uint32_t delay_ms, TimerCallback cb, void* arg = nullptr, uint32_t interval_ms = 0);
+
+	//取消尚未执行的定时器，已执行或不存在时返回false
+	//周期定时器在回调中也可以取消；已到期取出的回调仍会执行这一次
+	bool Cancel(uint64_t timer_id);
+
+	//执行now_ms之前到期的定时器，返回执行的个数
+	size_t Advance(uint64_t now_ms);
+	inline size_t Advance()
+	{
+		return Advance(GetTickMilliTime());
+	}
+
+	//距下一次需要Advance的毫秒数，用作epoll等的超时；没有定时器时返回-1
+	int NextTimeout();
+
+	inline size_t Size()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_count;
+	}
+
+	//启动驱动线程，与外部调用Advance二选一
+	bool Start();
+	void Stop();
+
+private:
+	struct TimerNode
+	{
+		ListNode link;
+		uint64_t expire;
+		uint32_t interval;
+		uint32_t index;
+		uint32_t generation;
+		TimerCallback cb;
+		void* arg;
+	};
+
+	struct Expired
+	{
+		uint64_t timer_id;
+		TimerCallback cb;
+		void* arg;
+	};
+
+	TimerNode* NodeAt(uint32_t index);
+	TimerNode* Find_(uint64_t timer_id);
+	uint64_t TimerId(const TimerNode* node) const;
+	TimerNode* NewNode_();
+	void FreeNode_(TimerNode* node);
+
+	void Add_(TimerNode* node);
+	uint32_t Cascade_(uint32_t level, uint32_t index);
+	void Tick_();
+	void Expire_(uint64_t now_ms, List* list, std::vector<Expired>& expired);
+	int NextTimeout_(uint64_t now_ms);
+
+	static void ThreadFunc(void* arg);
+	void Run();
+
+private:
+	static const uint32_t LEVEL_NUM = 5;
+	static const uint32_t ROOT_BITS = 8;
+	static const uint32_t LEVEL_BITS = 6;
+	static const uint32_t ROOT_SIZE = 1U << ROOT_BITS;
+	static const uint32_t LEVEL_SIZE = 1U << LEVEL_BITS;
+	static const uint32_t ROOT_MASK = ROOT_SIZE - 1;
+	static const uint32_t LEVEL_MASK = LEVEL_SIZE - 1;
+	static const uint64_t MAX_DELAY = (1ULL << (ROOT_BITS + (LEVEL_NUM - 1) * LEVEL_BITS)) - 1;
+
+	static const uint32_t NODE_BLOCK_BITS = 8;
+	static const uint32_t NODE_BLOCK_SIZE = 1U << NODE_BLOCK_BITS;
+
+	ThreadPool* m_pool;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+
+	List m_root[ROOT_SIZE];
+	List m_levels[LEVEL_NUM - 1][LEVEL_SIZE];
+
+	//下一个待处理的毫秒
+	uint64_t m_current;
+	size_t m_count;
+
+	std::vector<std::unique_ptr<TimerNode[]>> m_node_blocks;
+	std::vector<uint32_t> m_free_nodes;
+
+	Thread m_thread;
+	bool m_started;
+	bool m_stopping;
+	uint64_t m_wake_time;
+
+private:
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+};
+
+}
+
+#endif
+
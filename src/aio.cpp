@@ -22,6 +22,10 @@ enum AioState
 static std::atomic<AioState> s_state(AIO_STOPPED);
 
 static std::atomic<uint64_t> s_reqid(1);
+
+//io线程每次最多取出的请求数
+#define IO_BATCH_NUM	32
+
 static BlockingQueue<RequestEx>* s_io_request_queues = nullptr;
 static xfutil::ThreadGroup s_io_thread_group;
 
@@ -88,17 +92,21 @@ static void ProcessRequest(RequestEx& req_ex)
 	}
 }
 
+//每个io线程有自己的队列，退出标记是队列中最后一个请求，可以批量取出
 static void IOProcThreadFunc(int index, void* arg)
 {
+	std::vector<RequestEx> req_exs;
 	for(;;)
 	{
-		RequestEx req_ex;
-		s_io_request_queues[index].Pop(req_ex);
-		if(!req_ex.request)
-			break;
-		ProcessRequest(req_ex);
+		req_exs.clear();
+		s_io_request_queues[index].PopBatch(req_exs, IO_BATCH_NUM);
+		for(size_t i = 0; i < req_exs.size(); ++i)
+		{
+			if(!req_exs[i].request)
+				return;
+			ProcessRequest(req_exs[i]);
+		}
 	}
-	
 }
 
 static void PIOProcThreadFunc(int index, void* arg)
@@ -114,7 +122,7 @@ static void PIOProcThreadFunc(int index, void* arg)
 }
 
 
-int Start(int io_threadnum/* = -1*/, int pio_threadnum/* = -2*/)
+int Start(int io_threadnum/* = -1*/, int pio_threadnum/* = -2*/, bool numa_spread/* = false*/)
 {
 	AioState exp_state = AIO_STOPPED;
 	if(!s_state.compare_exchange_strong(exp_state, AIO_STARTING))
@@ -126,14 +134,19 @@ int Start(int io_threadnum/* = -1*/, int pio_threadnum/* = -2*/)
 	{
 		io_threadnum = -io_threadnum * SysInfo::GetCpuNum();
 	}
+	ThreadOptions options;
+	options.numa_spread = numa_spread;
+
 	s_io_request_queues = new BlockingQueue<RequestEx>[io_threadnum];
-	s_io_thread_group.Start(io_threadnum, IOProcThreadFunc);
+	options.name = "aio-io";
+	s_io_thread_group.Start(io_threadnum, IOProcThreadFunc, nullptr, options);
 
 	if(pio_threadnum < 0)
 	{
 		pio_threadnum = -pio_threadnum * SysInfo::GetCpuNum();
 	}
-	s_pio_thread_group.Start(pio_threadnum, PIOProcThreadFunc);
+	options.name = "aio-pio";
+	s_pio_thread_group.Start(pio_threadnum, PIOProcThreadFunc, nullptr, options);
 
 	s_state.store(AIO_STARTED);
 	return 0;
@@ -166,7 +179,7 @@ int Stop()
 	return 0;
 }
 
-uint64_t Submit(std::vector<Command>& cmds, CompleteCallback cb, void *arg/* = NULL*/)
+uint64_t Submit(const std::vector<Command>& cmds, CompleteCallback cb, void *arg/* = NULL*/)
 {
 	if(s_state.load() != AIO_STARTED)
 	{
@@ -180,7 +193,7 @@ uint64_t Submit(std::vector<Command>& cmds, CompleteCallback cb, void *arg/* = N
 	{
 		req_ex.cmd_idx = i;
 
-		Command& cmd = cmds[i];
+		const Command& cmd = cmds[i];
 		if(cmd.cmd < CMD_MIN_PIO)
 		{
 			size_t queue_idx = cmd.fd % s_io_thread_group.Size();
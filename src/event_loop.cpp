@@ -0,0 +1,205 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "xfutil/event_loop.h"
+
+namespace xfutil
+{
+
+//当前线程正在运行的事件循环，在循环线程中添加定时器时不需要唤醒
+static thread_local EventLoop* t_loop = nullptr;
+
+EventLoop::EventLoop()
+{
+    m_stopping.store(false, std::memory_order_relaxed);
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(m_epfd != INVALID_FILEID && m_wake_fd != INVALID_FILEID)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = m_wake_fd;
+        epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wake_fd, &ev);
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    if(m_wake_fd != INVALID_FILEID)
+    {
+        close(m_wake_fd);
+    }
+    if(m_epfd != INVALID_FILEID)
+    {
+        close(m_epfd);
+    }
+}
+
+bool EventLoop::Add(fileid_t fd, uint32_t events, const Entry& entry)
+{
+    if(m_entries.find(fd) != m_entries.end())
+    {
+        return false;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        return false;
+    }
+    m_entries[fd] = entry;
+    return true;
+}
+
+bool EventLoop::AddFd(fileid_t fd, uint32_t events, EventHandler handler, void* arg/* = nullptr*/)
+{
+    Entry entry;
+    entry.handler = handler;
+    entry.arg = arg;
+    entry.watcher = nullptr;
+    entry.watch_cb = nullptr;
+    return Add(fd, events, entry);
+}
+
+bool EventLoop::AddFileWatcher(FileWatcher& watcher, FileWatcher::EventCallback cb, void* arg/* = nullptr*/)
+{
+    Entry entry;
+    entry.handler = nullptr;
+    entry.arg = arg;
+    entry.watcher = &watcher;
+    entry.watch_cb = cb;
+    return Add(watcher.GetID(), EPOLLIN, entry);
+}
+
+bool EventLoop::ModifyFd(fileid_t fd, uint32_t events)
+{
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+bool EventLoop::RemoveFd(fileid_t fd)
+{
+    if(m_entries.erase(fd) == 0)
+    {
+        return false;
+    }
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+    return true;
+}
+
+uint64_t EventLoop::AddTimer(uint32_t delay_ms, TimerCallback cb, void* arg/* = nullptr*/, uint32_t interval_ms/* = 0*/)
+{
+    uint64_t timer_id = m_timers.Schedule(delay_ms, cb, arg, interval_ms);
+    if(t_loop != this)
+    {
+        //循环线程可能正按更晚的超时等待
+        Wakeup();
+    }
+    return timer_id;
+}
+
+bool EventLoop::CancelTimer(uint64_t timer_id)
+{
+    return m_timers.Cancel(timer_id);
+}
+
+void EventLoop::Wakeup()
+{
+    uint64_t value = 1;
+    ssize_t ret = write(m_wake_fd, &value, sizeof(value));
+    (void)ret;
+}
+
+int EventLoop::RunOnce(int timeout_ms/* = -1*/)
+{
+    int timer_timeout = m_timers.NextTimeout();
+    if(timer_timeout >= 0 && (timeout_ms < 0 || timer_timeout < timeout_ms))
+    {
+        timeout_ms = timer_timeout;
+    }
+
+    int num = epoll_wait(m_epfd, m_events, MAX_EVENT_NUM, timeout_ms);
+    if(num < 0)
+    {
+        return (LastError == EINTR) ? 0 : -1;
+    }
+
+    EventLoop* prev_loop = t_loop;
+    t_loop = this;
+
+    int handled = 0;
+    for(int i = 0; i < num; ++i)
+    {
+        fileid_t fd = m_events[i].data.fd;
+        if(fd == m_wake_fd)
+        {
+            uint64_t value;
+            ssize_t ret = read(m_wake_fd, &value, sizeof(value));
+            (void)ret;
+            continue;
+        }
+
+        //前面的回调可能已经Remove了这个fd，每次重新查找
+        auto it = m_entries.find(fd);
+        if(it == m_entries.end())
+        {
+            continue;
+        }
+        Entry entry = it->second;
+        if(entry.watcher != nullptr)
+        {
+            entry.watcher->ReadEvents(entry.watch_cb, entry.arg);
+        }
+        else
+        {
+            entry.handler(fd, m_events[i].events, entry.arg);
+        }
+        ++handled;
+    }
+
+    handled += (int)m_timers.Advance();
+
+    t_loop = prev_loop;
+    return handled;
+}
+
+void EventLoop::Run()
+{
+    while(!m_stopping.load(std::memory_order_acquire))
+    {
+        if(RunOnce(-1) < 0)
+        {
+            break;
+        }
+    }
+    m_stopping.store(false, std::memory_order_relaxed);
+}
+
+void EventLoop::Stop()
+{
+    m_stopping.store(true, std::memory_order_release);
+    Wakeup();
+}
+
+}
+
@@ -0,0 +1,408 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include "xfutil/fiber.h"
+
+namespace xfutil
+{
+
+//当前线程正在运行的协程
+static thread_local Fiber* t_fiber = nullptr;
+
+//协程可能在挂起后换到其他线程继续执行，不能让编译器缓存thread_local的地址，每次都重新取
+static Fiber* __attribute__((noinline)) GetCurrentFiber()
+{
+    return t_fiber;
+}
+
+static void __attribute__((noinline)) SetCurrentFiber(Fiber* fiber)
+{
+    t_fiber = fiber;
+}
+
+FiberScheduler::FiberScheduler()
+{
+    m_started = false;
+    m_stack_size = 0;
+    m_guard_size = 0;
+    m_stack_cache_num = 0;
+    m_fiber_num.store(0, std::memory_order_relaxed);
+}
+
+FiberScheduler::~FiberScheduler()
+{
+    //在协程中Stop不会停止调度器，析构后调度线程仍在运行
+    assert(!m_started || !InFiber());
+    Stop();
+}
+
+bool FiberScheduler::Start(int thread_count/* = 1*/, uint32_t stack_size/* = 64*1024*/, uint32_t cache_num/* = 1024*/)
+{
+    if(m_started || thread_count <= 0 || stack_size < 4096 || stack_size % 4096 != 0)
+    {
+        return false;
+    }
+
+    m_stack_size = stack_size;
+    m_guard_size = (uint32_t)sysconf(_SC_PAGESIZE);
+    m_stack_cache_num = cache_num;
+    m_started = true;
+
+    ThreadOptions options;
+    options.name = "fiber";
+    m_threads.Start(thread_count, ThreadFunc, this, options);
+    return true;
+}
+
+void FiberScheduler::Stop()
+{
+    //当前协程不结束，m_fiber_num不会归0；调度线程也不能Join自己
+    if(!m_started || InFiber())
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(m_fiber_num.load(std::memory_order_acquire) != 0)
+        {
+            m_idle_cond.wait(lock);
+        }
+    }
+
+    //nullptr是调度线程的退出标记
+    for(size_t i = 0; i < m_threads.Size(); ++i)
+    {
+        m_run_queue.Push(nullptr);
+    }
+    m_threads.Join();
+
+    for(size_t i = 0; i < m_free_stacks.size(); ++i)
+    {
+        munmap(m_free_stacks[i], m_guard_size + m_stack_size);
+    }
+    m_free_stacks.clear();
+    m_started = false;
+}
+
+bool FiberScheduler::Spawn(FiberFunc func, void* arg/* = nullptr*/)
+{
+    if(!m_started)
+    {
+        return false;
+    }
+
+    byte_t* stack = AllocStack();
+    if(stack == nullptr)
+    {
+        return false;
+    }
+
+    Fiber* fiber = new Fiber();
+    getcontext(&fiber->ctx);
+    fiber->ctx.uc_stack.ss_sp = stack + m_guard_size;
+    fiber->ctx.uc_stack.ss_size = m_stack_size;
+    fiber->ctx.uc_link = nullptr;
+    makecontext(&fiber->ctx, FiberEntry, 0);
+
+    fiber->sched_ctx = nullptr;
+    fiber->stack = stack;
+    fiber->one_cmd.resize(1);
+    fiber->func = func;
+    fiber->arg = arg;
+    fiber->sched = this;
+    fiber->state.store(FIBER_RUNNING, std::memory_order_relaxed);
+
+    m_fiber_num.fetch_add(1, std::memory_order_relaxed);
+    m_run_queue.Push(fiber);
+    return true;
+}
+
+//栈向下增长，映射的最低一页作为保护页
+byte_t* FiberScheduler::AllocStack()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stack_mutex);
+        if(!m_free_stacks.empty())
+        {
+            byte_t* stack = m_free_stacks.back();
+            m_free_stacks.pop_back();
+            return stack;
+        }
+    }
+
+    size_t size = (size_t)m_guard_size + m_stack_size;
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if(addr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    if(mprotect(addr, m_guard_size, PROT_NONE) != 0)
+    {
+        munmap(addr, size);
+        return nullptr;
+    }
+    return (byte_t*)addr;
+}
+
+void FiberScheduler::FreeStack(byte_t* stack)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stack_mutex);
+        if(m_free_stacks.size() < m_stack_cache_num)
+        {
+            m_free_stacks.push_back(stack);
+            return;
+        }
+    }
+    munmap(stack, (size_t)m_guard_size + m_stack_size);
+}
+
+void FiberScheduler::Free(Fiber* fiber)
+{
+    FreeStack(fiber->stack);
+    delete fiber;
+
+    if(m_fiber_num.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle_cond.notify_all();
+    }
+}
+
+void FiberScheduler::FiberEntry()
+{
+    Fiber* fiber = GetCurrentFiber();
+    fiber->func(fiber->arg);
+
+    //不会再切回来，栈由调度线程释放
+    fiber->state.store(FIBER_DONE, std::memory_order_relaxed);
+    swapcontext(&fiber->ctx, fiber->sched_ctx);
+}
+
+//切回当前调度线程，由调度线程根据state决定如何处理
+void FiberScheduler::Suspend(Fiber* fiber, int state)
+{
+    if(state != FIBER_SUSPENDING)
+    {
+        fiber->state.store(state, std::memory_order_relaxed);
+    }
+    swapcontext(&fiber->ctx, fiber->sched_ctx);
+}
+
+bool FiberScheduler::InFiber()
+{
+    return GetCurrentFiber() != nullptr;
+}
+
+void FiberScheduler::Yield()
+{
+    Fiber* fiber = GetCurrentFiber();
+    if(fiber == nullptr)
+    {
+        Thread::Yield();
+        return;
+    }
+    Suspend(fiber, FIBER_YIELD);
+}
+
+void FiberScheduler::Resume(Fiber* fiber)
+{
+    int state = fiber->state.load(std::memory_order_acquire);
+    for(;;)
+    {
+        if(state == FIBER_SUSPENDING)
+        {
+            //还没切回调度线程，由调度线程放回运行队列
+            if(fiber->state.compare_exchange_weak(state, FIBER_WAKEUP, std::memory_order_acq_rel))
+            {
+                return;
+            }
+        }
+        else if(state == FIBER_SUSPENDED)
+        {
+            if(fiber->state.compare_exchange_weak(state, FIBER_RUNNING, std::memory_order_acq_rel))
+            {
+                fiber->sched->m_run_queue.Push(fiber);
+                return;
+            }
+        }
+        else
+        {
+            assert(false);
+            return;
+        }
+    }
+}
+
+void FiberScheduler::ThreadFunc(int index, void* arg)
+{
+    FiberScheduler* sched = (FiberScheduler*)arg;
+    sched->Run();
+}
+
+void FiberScheduler::Run()
+{
+    ucontext_t sched_ctx;
+    for(;;)
+    {
+        Fiber* fiber = nullptr;
+        m_run_queue.Pop(fiber);
+        if(fiber == nullptr)
+        {
+            break;
+        }
+
+        fiber->sched_ctx = &sched_ctx;
+        fiber->state.store(FIBER_RUNNING, std::memory_order_relaxed);
+        SetCurrentFiber(fiber);
+        swapcontext(&sched_ctx, &fiber->ctx);
+        SetCurrentFiber(nullptr);
+
+        //协程的上下文已保存，这之后才能被其他线程恢复
+        int state = fiber->state.load(std::memory_order_acquire);
+        if(state == FIBER_DONE)
+        {
+            Free(fiber);
+        }
+        else if(state == FIBER_YIELD)
+        {
+            m_run_queue.Push(fiber);
+        }
+        else if(state == FIBER_SUSPENDING)
+        {
+            if(!fiber->state.compare_exchange_strong(state, FIBER_SUSPENDED, std::memory_order_acq_rel))
+            {
+                //挂起期间已被Resume
+                assert(state == FIBER_WAKEUP);
+                m_run_queue.Push(fiber);
+            }
+        }
+        else
+        {
+            //FIBER_WAKEUP
+            m_run_queue.Push(fiber);
+        }
+    }
+}
+
+struct AwaitContext
+{
+    Fiber* fiber;
+    std::vector<aio::Command>* cmds;
+    uint32_t fail_cnt;
+};
+
+void FiberScheduler::AwaitCallback(const std::vector<aio::Command>& cmds, uint32_t cmd_fail_cnt, int64_t elapsed_time, void* arg)
+{
+    AwaitContext* ctx = (AwaitContext*)arg;
+    for(size_t i = 0; i < cmds.size(); ++i)
+    {
+        (*ctx->cmds)[i].ret = cmds[i].ret;
+        (*ctx->cmds)[i].error = cmds[i].error;
+    }
+    ctx->fail_cnt = cmd_fail_cnt;
+    Resume(ctx->fiber);
+}
+
+int FiberScheduler::Await(std::vector<aio::Command>& cmds)
+{
+    Fiber* fiber = GetCurrentFiber();
+    if(fiber == nullptr || cmds.empty())
+    {
+        return -1;
+    }
+
+    //AwaitContext在协程栈上，协程恢复前回调已写完
+    AwaitContext ctx;
+    ctx.fiber = fiber;
+    ctx.cmds = &cmds;
+    ctx.fail_cnt = 0;
+
+    //先标记为挂起中，完成回调可能在切换前就到来
+    fiber->state.store(FIBER_SUSPENDING, std::memory_order_release);
+    if(aio::Submit(cmds, AwaitCallback, &ctx) == 0)
+    {
+        fiber->state.store(FIBER_RUNNING, std::memory_order_relaxed);
+        return -1;
+    }
+    Suspend(fiber, FIBER_SUSPENDING);
+    return (int)ctx.fail_cnt;
+}
+
+//复用协程自带的单元素vector，只在协程中调用
+ssize_t FiberScheduler::AwaitOne(aio::Command& cmd)
+{
+    std::vector<aio::Command>& cmds = GetCurrentFiber()->one_cmd;
+    cmds[0] = cmd;
+    if(Await(cmds) < 0)
+    {
+        return -1;
+    }
+    if(cmds[0].ret < 0)
+    {
+        LastError = cmds[0].error;
+    }
+    return cmds[0].ret;
+}
+
+ssize_t FiberScheduler::AwaitRead(int fd, void* buf, size_t size)
+{
+    if(!InFiber())
+    {
+        return ::read(fd, buf, size);
+    }
+    aio::Command cmd;
+    cmd.Read(fd, buf, size);
+    return AwaitOne(cmd);
+}
+
+ssize_t FiberScheduler::AwaitRead(int fd, uint64_t pos, void* buf, size_t size)
+{
+    if(!InFiber())
+    {
+        return ::pread(fd, buf, size, pos);
+    }
+    aio::Command cmd;
+    cmd.Read(fd, pos, buf, size);
+    return AwaitOne(cmd);
+}
+
+ssize_t FiberScheduler::AwaitWrite(int fd, const void* buf, size_t size)
+{
+    if(!InFiber())
+    {
+        return ::write(fd, buf, size);
+    }
+    aio::Command cmd;
+    cmd.Write(fd, (void*)buf, size);
+    return AwaitOne(cmd);
+}
+
+ssize_t FiberScheduler::AwaitWrite(int fd, uint64_t pos, const void* buf, size_t size)
+{
+    if(!InFiber())
+    {
+        return ::pwrite(fd, buf, size, pos);
+    }
+    aio::Command cmd;
+    cmd.Write(fd, pos, (void*)buf, size);
+    return AwaitOne(cmd);
+}
+
+}
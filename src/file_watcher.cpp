@@ -53,8 +53,8 @@ FileWatcher::~FileWatcher()
 
 bool FileWatcher::Add(const std::string& path, uint32_t events)
 {
-	assert(m_ifd == INVALID_FILEID);
-	if(m_ifd != INVALID_FILEID)
+	assert(m_ifd != INVALID_FILEID);
+	if(m_ifd == INVALID_FILEID)
 	{
 		return false;
 	}
@@ -151,6 +151,36 @@ void FileWatcher::HandleEvent(char* buf, char* end, EventCallback cb, void* arg/
     }
 }
 
+int FileWatcher::ReadEvents(EventCallback cb, void* arg/* = nullptr*/)
+{
+    assert(cb != nullptr);
+
+    char buf[IBUF_SIZE];
+    int num = 0;
+    for(;;)
+    {
+        ssize_t rsize = read(m_ifd, buf, IBUF_SIZE);
+        if(rsize > 0)
+        {
+            HandleEvent(buf, buf+rsize, cb, arg);
+            ++num;
+        }
+        else if(rsize < 0 && LastError == EINTR)
+        {
+            continue;
+        }
+        else if(rsize < 0 && LastError != EAGAIN)
+        {
+            return -1;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return num;
+}
+
 int FileWatcher::Read(uint32_t timeout_ms, EventCallback cb, void* arg/* = nullptr*/)
 {
     assert(cb != nullptr);
@@ -0,0 +1,124 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include "xfutil/frequency_sketch.h"
+
+namespace xfutil
+{
+
+FrequencySketch::FrequencySketch(size_t entry_num)
+{
+	//宽度取2的幂，至少64
+	m_width = 64;
+	m_shift = 26;
+	while(m_width < entry_num && m_shift > 0)
+	{
+		m_width <<= 1;
+		--m_shift;
+	}
+	m_counters.resize(ROW_NUM * m_width);
+
+	//doorkeeper每个key约8bit
+	m_doorkeeper_bits = (uint64_t)m_width * 8;
+	m_doorkeeper.resize(m_doorkeeper_bits / 8);
+
+	m_sample_size = m_width * 10;
+	m_additions = 0;
+}
+
+void FrequencySketch::Increment(uint32_t hc)
+{
+	//第一次出现只记入doorkeeper
+	if(SetDoorkeeper(hc))
+	{
+		for(uint32_t i = 0; i < ROW_NUM; ++i)
+		{
+			uint8_t& counter = m_counters[Index(hc, i)];
+			if(counter < MAX_COUNT)
+			{
+				++counter;
+			}
+		}
+	}
+
+	if(++m_additions >= m_sample_size)
+	{
+		Reset();
+	}
+}
+
+uint32_t FrequencySketch::Estimate(uint32_t hc) const
+{
+	uint32_t count = MAX_COUNT;
+	for(uint32_t i = 0; i < ROW_NUM; ++i)
+	{
+		count = MIN(count, m_counters[Index(hc, i)]);
+	}
+	return CheckDoorkeeper(hc) ? count + 1 : count;
+}
+
+void FrequencySketch::Clear()
+{
+	memset(m_counters.data(), 0, m_counters.size());
+	memset(m_doorkeeper.data(), 0, m_doorkeeper.size());
+	m_additions = 0;
+}
+
+bool FrequencySketch::CheckDoorkeeper(uint32_t hc) const
+{
+	for(uint32_t j = 0; j < DOORKEEPER_K_NUM; ++j)
+	{
+		const uint32_t bit_pos = hc % m_doorkeeper_bits;
+		if((m_doorkeeper[bit_pos / 8] & (1 << (bit_pos % 8))) == 0)
+		{
+			return false;
+		}
+		hc = (hc >> 1) | (hc << 31);
+	}
+	return true;
+}
+
+//返回设置前是否已全部置位
+bool FrequencySketch::SetDoorkeeper(uint32_t hc)
+{
+	bool exist = true;
+	for(uint32_t j = 0; j < DOORKEEPER_K_NUM; ++j)
+	{
+		const uint32_t bit_pos = hc % m_doorkeeper_bits;
+		byte_t mask = (byte_t)(1 << (bit_pos % 8));
+		if((m_doorkeeper[bit_pos / 8] & mask) == 0)
+		{
+			m_doorkeeper[bit_pos / 8] |= mask;
+			exist = false;
+		}
+		hc = (hc >> 1) | (hc << 31);
+	}
+	return exist;
+}
+
+//老化：计数减半，doorkeeper清空
+void FrequencySketch::Reset()
+{
+	for(size_t i = 0; i < m_counters.size(); ++i)
+	{
+		m_counters[i] >>= 1;
+	}
+	memset(m_doorkeeper.data(), 0, m_doorkeeper.size());
+	m_additions = 0;
+}
+
+}
+
@@ -76,6 +76,34 @@ uint32_t Hash32(uint64_t value, uint32_t seed)
 	return h;
 }
 
-}
+struct Crc32Table
+{
+	Crc32Table()
+	{
+		for(uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for(int k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+			}
+			table[i] = c;
+		}
+	}
+
+	uint32_t table[256];
+};
 
+uint32_t Crc32(const byte_t* data, size_t len, uint32_t crc)
+{
+	static const Crc32Table s_table;
 
+	crc = ~crc;
+	for(size_t i = 0; i < len; ++i)
+	{
+		crc = s_table.table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+}
@@ -19,7 +19,7 @@ limitations under the License.
 #include <stdarg.h>
 #include <sys/time.h>
 #include "xfutil/path.h"
-#include "xfutil/queue.h"
+#include "xfutil/ring_queue.h"
 #include "xfutil/thread.h"
 #include "xfutil/file.h"
 #include "xfutil/strutil.h"
@@ -45,10 +45,12 @@ const char* LEVEL_DESC[LogLevel::LEVEL_MAX] =
 #undef CACHE_NUM 
 #define CACHE_NUM       1024
 
+//RingQueue的容量必须是2的幂
 #undef QUEUE_CAPACITY
-#define QUEUE_CAPACITY  10000
+#define QUEUE_CAPACITY  16384
 
 LoggerImpl::LoggerImpl()
+    : m_data_queue(QUEUE_CAPACITY)
 {
     m_started = false;
     m_filesize = 0;
@@ -128,11 +130,11 @@ bool LoggerImpl::Start(const LogConfig& conf)
 
     m_pool.Init(BLOCK_SIZE, CACHE_NUM);
 
-	//初始化队列
-	m_data_queue.SetCapacity(QUEUE_CAPACITY);
-	
 	//启用线程
-	m_thread.Start(LogThread, this);
+	ThreadOptions options;
+	options.name = "logger";
+	options.cpus = m_conf.thread_cpus;
+	m_thread.Start(LogThread, this, options);
 	
     m_started = true;
 	return true;
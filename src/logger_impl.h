@@ -22,7 +22,7 @@ limitations under the License.
 #include <stdarg.h>
 #include "xfutil/path.h"
 #include "xfutil/logger.h"
-#include "xfutil/queue.h"
+#include "xfutil/ring_queue.h"
 #include "xfutil/thread.h"
 #include "xfutil/file.h"
 #include "xfutil/strutil.h"
@@ -67,7 +67,7 @@ private:
 
 	File m_logfile;
     uint64_t m_filesize;
-	BlockingQueue<LogData> m_data_queue;
+	RingQueue<LogData> m_data_queue;
 	Thread m_thread;
     BlockPool m_pool;
 };
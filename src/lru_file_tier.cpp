@@ -0,0 +1,386 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include "xfutil/lru_file_tier.h"
+#include "xfutil/coding.h"
+#include "xfutil/directory.h"
+#include "xfutil/path.h"
+
+namespace xfutil
+{
+
+LruFileTier::LruFileTier()
+{
+	m_max_size = 0;
+	m_segment_size = 0;
+	m_next_segment_id = 0;
+	m_total_size = 0;
+	m_active_id = 0;
+	m_active_size = 0;
+	m_buf_offset = 0;
+}
+
+LruFileTier::~LruFileTier()
+{
+	for(auto it = m_segments.begin(); it != m_segments.end(); ++it)
+	{
+		char path[MAX_PATH_LEN];
+		snprintf(path, sizeof(path), "%s/%u.seg", m_dir.c_str(), it->first);
+		File::Remove(path);
+	}
+}
+
+bool LruFileTier::Open(const char* dir, uint64_t max_size, uint32_t segment_size/* = 16*1024*1024*/)
+{
+	//Create_r会临时修改路径串
+	std::string dir_path(dir);
+	if(!Directory::Exist(dir) && !Directory::Create_r(&dir_path[0]))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_write_mutex);
+	if(!m_segments.empty())
+	{
+		return false;
+	}
+	m_dir = dir;
+	m_max_size = max_size;
+	m_segment_size = segment_size;
+
+	return NewSegment();
+}
+
+bool LruFileTier::NewSegment()
+{
+	if(!Flush())
+	{
+		return false;
+	}
+
+	char path[MAX_PATH_LEN];
+	snprintf(path, sizeof(path), "%s/%u.seg", m_dir.c_str(), m_next_segment_id);
+
+	std::shared_ptr<File> file = std::make_shared<File>();
+	if(!file->Open(path, File::OF_CREATE|File::OF_READWRITE|File::OF_TRUNCATE))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Segment& segment = m_segments[m_next_segment_id];
+	segment.file = file;
+	segment.size = 0;
+	segment.live_size = 0;
+
+	m_active_id = m_next_segment_id++;
+	m_active_size = 0;
+	m_buf_offset = 0;
+	m_buf.clear();
+	return true;
+}
+
+bool LruFileTier::Flush()
+{
+	if(m_buf.empty())
+	{
+		return true;
+	}
+
+	//m_buf只有写入者修改，写文件时其他线程的Get只会读取
+	size_t size = m_buf.size();
+	int64_t ws = m_segments.find(m_active_id)->second.file->Write(m_buf_offset, m_buf.data(), size);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_buf_offset += size;
+	m_buf.clear();
+	return ws == (int64_t)size;
+}
+
+void LruFileTier::Append(uint32_t hc, const byte_t* data, uint32_t size)
+{
+	uint32_t record_size = RECORD_HEAD_SIZE + size;
+
+	byte_t head[RECORD_HEAD_SIZE];
+	EncodeFixed(EncodeFixed(head, record_size), hc);
+	m_buf.append((char*)head, sizeof(head));
+	m_buf.append((char*)data, size);
+
+	Location loc;
+	loc.segment_id = m_active_id;
+	loc.offset = m_active_size;
+	loc.size = record_size;
+	m_index.insert(std::make_pair(hc, loc));
+
+	Segment& segment = m_segments[m_active_id];
+	segment.size += record_size;
+	segment.live_size += record_size;
+
+	m_active_size += record_size;
+	m_total_size += record_size;
+}
+
+bool LruFileTier::Write(uint32_t hc, const byte_t* data, uint32_t size, const Location* old)
+{
+	if(m_active_size + RECORD_HEAD_SIZE + size > m_segment_size && !NewSegment())
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(old != nullptr && !EraseLocation(hc, old->segment_id, old->offset))
+		{
+			return true;
+		}
+		Append(hc, data, size);
+	}
+
+	if(m_buf.size() >= FLUSH_SIZE)
+	{
+		return Flush();
+	}
+	return true;
+}
+
+bool LruFileTier::Put(uint32_t hc, const byte_t* data, uint32_t size)
+{
+	if(RECORD_HEAD_SIZE + (uint64_t)size > m_segment_size)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_write_mutex);
+	if(m_segments.empty() || !Write(hc, data, size, nullptr))
+	{
+		return false;
+	}
+	while(m_total_size > m_max_size && m_segments.size() > 1)
+	{
+		Collect();
+	}
+	return true;
+}
+
+bool LruFileTier::Get(uint32_t hc, std::vector<std::string>& datas, std::vector<uint64_t>* ids/* = nullptr*/)
+{
+	struct Pending
+	{
+		std::shared_ptr<File> file;
+		Location loc;
+	};
+	std::vector<Pending> pendings;
+
+	datas.clear();
+	if(ids != nullptr)
+	{
+		ids->clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto range = m_index.equal_range(hc);
+		for(auto it = range.first; it != range.second; ++it)
+		{
+			const Location& loc = it->second;
+			if(loc.segment_id == m_active_id && loc.offset >= m_buf_offset)
+			{
+				//还在写缓冲中
+				datas.push_back(m_buf.substr(loc.offset - m_buf_offset + RECORD_HEAD_SIZE, loc.size - RECORD_HEAD_SIZE));
+				if(ids != nullptr)
+				{
+					ids->push_back(LocationID(loc));
+				}
+			}
+			else
+			{
+				Pending pending;
+				pending.file = m_segments[loc.segment_id].file;
+				pending.loc = loc;
+				pendings.push_back(pending);
+			}
+		}
+	}
+
+	//文件读在锁外进行，段被回收时文件由shared_ptr保持打开
+	std::string record;
+	for(size_t i = 0; i < pendings.size(); ++i)
+	{
+		const Location& loc = pendings[i].loc;
+		record.resize(loc.size);
+		if(pendings[i].file->Read(loc.offset, &record[0], loc.size) != (int64_t)loc.size)
+		{
+			continue;
+		}
+
+		const byte_t* ptr = (byte_t*)record.data();
+		const byte_t* end = ptr + record.size();
+		uint32_t record_size = 0, record_hc = 0;
+		DecodeFixed(ptr, end, record_size);
+		DecodeFixed(ptr, end, record_hc);
+		if(record_size == loc.size && record_hc == hc)
+		{
+			datas.push_back(record.substr(RECORD_HEAD_SIZE));
+			if(ids != nullptr)
+			{
+				ids->push_back(LocationID(loc));
+			}
+		}
+	}
+	return !datas.empty();
+}
+
+bool LruFileTier::Contains(uint32_t hc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_index.find(hc) != m_index.end();
+}
+
+bool LruFileTier::Remove(uint32_t hc, uint64_t id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto range = m_index.equal_range(hc);
+	for(auto it = range.first; it != range.second; ++it)
+	{
+		if(LocationID(it->second) == id)
+		{
+			m_segments[it->second.segment_id].live_size -= it->second.size;
+			m_index.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t LruFileTier::Count()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_index.size();
+}
+
+uint64_t LruFileTier::Size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total_size;
+}
+
+bool LruFileTier::EraseLocation(uint32_t hc, uint32_t segment_id, uint32_t offset)
+{
+	auto range = m_index.equal_range(hc);
+	for(auto it = range.first; it != range.second; ++it)
+	{
+		if(it->second.segment_id == segment_id && it->second.offset == offset)
+		{
+			m_index.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+void LruFileTier::Collect()
+{
+	uint32_t segment_id;
+	bool compact;
+	std::shared_ptr<File> file;
+	uint32_t segment_size;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		//在已写满的段中选存活数据最少的
+		auto victim = m_segments.begin();
+		for(auto it = m_segments.begin(); it != m_segments.end(); ++it)
+		{
+			if(it->first != m_active_id && it->second.live_size < victim->second.live_size)
+			{
+				victim = it;
+			}
+		}
+		//存活过多时搬迁不划算，丢弃最旧的段
+		compact = (victim->second.live_size <= victim->second.size / 2);
+		if(!compact)
+		{
+			victim = m_segments.begin();
+		}
+		segment_id = victim->first;
+		file = victim->second.file;
+		segment_size = victim->second.size;
+	}
+
+	//已写满的段都已刷盘，读文件和搬迁写入都不持有m_mutex
+	std::string data(segment_size, '\0');
+	bool clean = (file->Read(0, &data[0], segment_size) == (int64_t)segment_size);
+	if(clean)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+		if(!compact)
+		{
+			lock.lock();
+		}
+
+		const byte_t* ptr = (byte_t*)data.data();
+		const byte_t* end = ptr + data.size();
+		while(ptr + RECORD_HEAD_SIZE <= end)
+		{
+			uint32_t offset = ptr - (byte_t*)data.data();
+			uint32_t record_size = 0, hc = 0;
+			DecodeFixed(ptr, end, record_size);
+			DecodeFixed(ptr, end, hc);
+			if(record_size < RECORD_HEAD_SIZE || offset + record_size > data.size())
+			{
+				clean = false;
+				break;
+			}
+			uint32_t size = record_size - RECORD_HEAD_SIZE;
+			if(compact)
+			{
+				Location loc;
+				loc.segment_id = segment_id;
+				loc.offset = offset;
+				loc.size = record_size;
+				clean = Write(hc, ptr, size, &loc) && clean;
+			}
+			else
+			{
+				EraseLocation(hc, segment_id, offset);
+			}
+			ptr += size;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(!clean)
+		{
+			//读失败或搬迁失败时遍历索引删除
+			for(auto it = m_index.begin(); it != m_index.end(); )
+			{
+				it = (it->second.segment_id == segment_id) ? m_index.erase(it) : std::next(it);
+			}
+		}
+
+		auto victim = m_segments.find(segment_id);
+		m_total_size -= victim->second.size;
+		m_segments.erase(victim);
+	}
+
+	char path[MAX_PATH_LEN];
+	snprintf(path, sizeof(path), "%s/%u.seg", m_dir.c_str(), segment_id);
+	File::Remove(path);
+}
+
+}
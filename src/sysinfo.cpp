@@ -0,0 +1,171 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "xfutil/sysinfo.h"
+
+namespace xfutil
+{
+
+#ifdef __linux__
+
+#define SYS_NODE_PATH   "/sys/devices/system/node"
+
+//NUMA拓扑，进程内只读取一次
+struct NumaTopology
+{
+    NumaTopology();
+
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<uint32_t> cpu_nodes;
+};
+
+static bool ReadLine(const char* path, char* line, size_t size)
+{
+    FILE* fp = fopen(path, "r");
+    if(fp == nullptr)
+    {
+        return false;
+    }
+    bool ok = (fgets(line, (int)size, fp) != nullptr);
+    fclose(fp);
+    return ok;
+}
+
+NumaTopology::NumaTopology()
+{
+    char line[4096];
+    std::vector<int> nodes;
+    if(ReadLine(SYS_NODE_PATH "/online", line, sizeof(line)))
+    {
+        SysInfo::ParseCpuList(line, nodes);
+    }
+
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        char path[256];
+        snprintf(path, sizeof(path), SYS_NODE_PATH "/node%d/cpulist", nodes[i]);
+
+        std::vector<int> cpus;
+        if(ReadLine(path, line, sizeof(line)) && SysInfo::ParseCpuList(line, cpus) && !cpus.empty())
+        {
+            node_cpus.push_back(cpus);
+        }
+    }
+
+    //没有NUMA信息时，所有CPU属于同一个节点
+    if(node_cpus.empty())
+    {
+        std::vector<int> cpus(SysInfo::GetCpuNum());
+        for(size_t i = 0; i < cpus.size(); ++i)
+        {
+            cpus[i] = (int)i;
+        }
+        node_cpus.push_back(cpus);
+    }
+
+    for(size_t i = 0; i < node_cpus.size(); ++i)
+    {
+        const std::vector<int>& cpus = node_cpus[i];
+        for(size_t j = 0; j < cpus.size(); ++j)
+        {
+            if((size_t)cpus[j] >= cpu_nodes.size())
+            {
+                cpu_nodes.resize(cpus[j] + 1, 0);
+            }
+            cpu_nodes[cpus[j]] = (uint32_t)i;
+        }
+    }
+}
+
+static const NumaTopology& GetNumaTopology()
+{
+    static NumaTopology s_topology;
+    return s_topology;
+}
+
+uint32_t SysInfo::GetNumaNodeNum()
+{
+    return (uint32_t)GetNumaTopology().node_cpus.size();
+}
+
+bool SysInfo::GetNumaNodeCpus(uint32_t index, std::vector<int>& cpus)
+{
+    const NumaTopology& topology = GetNumaTopology();
+    if(index >= topology.node_cpus.size())
+    {
+        return false;
+    }
+    cpus = topology.node_cpus[index];
+    return true;
+}
+
+uint32_t SysInfo::GetCpuNumaNode(int cpu)
+{
+    const NumaTopology& topology = GetNumaTopology();
+    if(cpu < 0 || (size_t)cpu >= topology.cpu_nodes.size())
+    {
+        return 0;
+    }
+    return topology.cpu_nodes[cpu];
+}
+
+bool SysInfo::ParseCpuList(const char* str, std::vector<int>& cpus)
+{
+    cpus.clear();
+    const char* p = str;
+    for(;;)
+    {
+        while(*p == ' ' || *p == ',')
+        {
+            ++p;
+        }
+        if(*p == '\0' || *p == '\n')
+        {
+            return true;
+        }
+
+        char* end = nullptr;
+        long first = strtol(p, &end, 10);
+        if(end == p || first < 0)
+        {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if(*p == '-')
+        {
+            ++p;
+            last = strtol(p, &end, 10);
+            if(end == p || last < first)
+            {
+                return false;
+            }
+            p = end;
+        }
+
+        for(long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back((int)cpu);
+        }
+    }
+}
+
+#endif
+
+}
+
@@ -14,11 +14,105 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ***************************************************************************/
 
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
 #include "xfutil/thread.h"
+#include "xfutil/sysinfo.h"
 
 namespace xfutil
 {
 
+//pthread_setname_np限制为16字节(含结尾0)
+#define MAX_THREAD_NAME_LEN     15
+
+//index为ThreadGroup中的下标，单个Thread为-1
+static void ApplyThreadOptions(const ThreadOptions& options, int index)
+{
+    if(!options.name.empty())
+    {
+        //截断前缀而不是下标，保证组内线程名不同
+        std::string suffix = (index >= 0) ? "-" + std::to_string(index) : "";
+        std::string name = options.name.substr(0, MAX_THREAD_NAME_LEN - MIN(suffix.size(), (size_t)MAX_THREAD_NAME_LEN)) + suffix;
+        Thread::SetName(name.c_str());
+    }
+
+    if(!options.cpus.empty())
+    {
+        Thread::SetAffinity(options.cpus);
+    }
+    else if(options.numa_spread && index >= 0)
+    {
+        //单节点时绑定只会丢掉节点外的CPU限制，没有收益
+        uint32_t node_num = SysInfo::GetNumaNodeNum();
+        if(node_num > 1)
+        {
+            Thread::BindNumaNode(index % node_num);
+        }
+    }
+}
+
+bool Thread::Start(ThreadFunc func, void* arg, const ThreadOptions& options)
+{
+    std::thread t([func, arg, options]() {
+        ApplyThreadOptions(options, -1);
+        func(arg);
+    });
+    m_thread.swap(t);
+    return true;
+}
+
+bool Thread::SetName(const char* name)
+{
+    char buf[MAX_THREAD_NAME_LEN + 1];
+    snprintf(buf, sizeof(buf), "%s", name);
+    return pthread_setname_np(pthread_self(), buf) == 0;
+}
+
+bool Thread::SetAffinity(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(size_t i = 0; i < cpus.size(); ++i)
+    {
+        if(cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+        {
+            CPU_SET(cpus[i], &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+//只保留当前亲和性允许的CPU，不会越过taskset/cgroup的限制
+bool Thread::BindNumaNode(uint32_t index)
+{
+    std::vector<int> node_cpus;
+    if(!SysInfo::GetNumaNodeCpus(index, node_cpus))
+    {
+        return false;
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return false;
+    }
+    std::vector<int> cpus;
+    for(size_t i = 0; i < node_cpus.size(); ++i)
+    {
+        if(node_cpus[i] >= 0 && node_cpus[i] < CPU_SETSIZE && CPU_ISSET(node_cpus[i], &allowed))
+        {
+            cpus.push_back(node_cpus[i]);
+        }
+    }
+    if(cpus.empty())
+    {
+        return false;
+    }
+    return SetAffinity(cpus);
+}
+
 void ThreadGroup::Start(int thread_count, GThreadFunc func, void* arg/* = nullptr*/)
 {
     std::vector<std::thread> threads;
@@ -34,6 +128,24 @@ void ThreadGroup::Start(int thread_count, GThreadFunc func, void* arg/* = nullpt
     m_threads.swap(threads);
 }
 
+void ThreadGroup::Start(int thread_count, GThreadFunc func, void* arg, const ThreadOptions& options)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+
+    for(int i = 0; i < thread_count; ++i)
+    {
+        std::thread th([func, i, arg, options]() {
+            ApplyThreadOptions(options, i);
+            func(i, arg);
+        });
+        threads.push_back(std::move(th));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_threads.swap(threads);
+}
+
 void ThreadGroup::Detach()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
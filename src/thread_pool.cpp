@@ -0,0 +1,436 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include "xfutil/thread_pool.h"
+#include "xfutil/sysinfo.h"
+
+namespace xfutil
+{
+
+//当前线程所属的线程池和下标
+static thread_local ThreadPool* t_pool = nullptr;
+static thread_local int t_worker_index = -1;
+
+TaskDeque::TaskDeque()
+{
+    m_top.store(0, std::memory_order_relaxed);
+    m_bottom.store(0, std::memory_order_relaxed);
+    m_array.store(NewArray(INIT_CAPACITY, nullptr), std::memory_order_relaxed);
+}
+
+TaskDeque::~TaskDeque()
+{
+    Array* array = m_array.load(std::memory_order_relaxed);
+    while(array != nullptr)
+    {
+        Array* prev = array->prev;
+        delete[] array->tasks;
+        delete array;
+        array = prev;
+    }
+}
+
+TaskDeque::Array* TaskDeque::NewArray(int64_t capacity, Array* prev)
+{
+    Array* array = new Array();
+    array->capacity = capacity;
+    array->tasks = new std::atomic<PoolTask*>[capacity];
+    array->prev = prev;
+    return array;
+}
+
+TaskDeque::Array* TaskDeque::Grow(Array* array, int64_t bottom, int64_t top)
+{
+    Array* new_array = NewArray(array->capacity * 2, array);
+    for(int64_t i = top; i < bottom; ++i)
+    {
+        new_array->Put(i, array->Get(i));
+    }
+    m_array.store(new_array, std::memory_order_release);
+    return new_array;
+}
+
+void TaskDeque::Push(PoolTask* task)
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    Array* array = m_array.load(std::memory_order_relaxed);
+    if(bottom - top > array->capacity - 1)
+    {
+        array = Grow(array, bottom, top);
+    }
+    array->Put(bottom, task);
+    m_bottom.store(bottom + 1, std::memory_order_release);
+}
+
+PoolTask* TaskDeque::Pop()
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array* array = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if(top > bottom)
+    {
+        //空
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    PoolTask* task = array->Get(bottom);
+    if(top == bottom)
+    {
+        //最后一个，与窃取者竞争
+        if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            task = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+PoolTask* TaskDeque::Steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if(top >= bottom)
+    {
+        return nullptr;
+    }
+
+    Array* array = m_array.load(std::memory_order_acquire);
+    PoolTask* task = array->Get(top);
+    if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return task;
+}
+
+ThreadPool::ThreadPool()
+{
+    m_state.store(STATE_STOPPED, std::memory_order_relaxed);
+    m_push_num.store(0, std::memory_order_relaxed);
+    m_stopping.store(false, std::memory_order_relaxed);
+    m_idle_num.store(0, std::memory_order_relaxed);
+    m_wake_epoch.store(0, std::memory_order_relaxed);
+}
+
+ThreadPool::~ThreadPool()
+{
+    Stop();
+}
+
+bool ThreadPool::Start(int thread_count/* = -1*/, size_t queue_capacity/* = 4096*/, const ThreadOptions& options/* = ThreadOptions()*/)
+{
+    if(m_state.load(std::memory_order_acquire) != STATE_STOPPED)
+    {
+        return false;
+    }
+    if(thread_count < 0)
+    {
+        thread_count = -thread_count * SysInfo::GetCpuNum();
+    }
+    if(thread_count == 0)
+    {
+        return false;
+    }
+
+    m_queue.reset(new RingQueue<PoolTask*>(queue_capacity));
+    m_workers.resize(thread_count);
+    for(int i = 0; i < thread_count; ++i)
+    {
+        m_workers[i] = new Worker();
+        m_workers[i]->seed = i * 2654435761U + 1;
+    }
+    m_stopping.store(false, std::memory_order_relaxed);
+    m_state.store(STATE_RUNNING, std::memory_order_release);
+
+    m_threads.Start(thread_count, WorkerFunc, this, options);
+    return true;
+}
+
+//先切换到STOPPING让新的Submit直接执行，等正在放入的外部线程完成后再通知工作线程退出
+void ThreadPool::Stop()
+{
+    if(WorkerIndex() >= 0)
+    {
+        return;
+    }
+    int state = STATE_RUNNING;
+    if(!m_state.compare_exchange_strong(state, STATE_STOPPING, std::memory_order_seq_cst))
+    {
+        //其他线程正在停止时等它完成
+        while(m_state.load(std::memory_order_acquire) == STATE_STOPPING)
+        {
+            Thread::Yield();
+        }
+        return;
+    }
+    while(m_push_num.load(std::memory_order_seq_cst) != 0)
+    {
+        Thread::Yield();
+    }
+
+    m_stopping.store(true, std::memory_order_seq_cst);
+    m_wake_epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(&m_wake_epoch, INT_MAX);
+    m_threads.Join();
+
+    //工作线程已退出，剩下的任务在当前线程执行
+    PoolTask* task;
+    while((task = FindTask(nullptr)) != nullptr)
+    {
+        task->Run();
+        delete task;
+    }
+
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        delete m_workers[i];
+    }
+    m_workers.clear();
+    m_queue.reset();
+    m_state.store(STATE_STOPPED, std::memory_order_release);
+}
+
+int ThreadPool::WorkerIndex() const
+{
+    return (t_pool == this) ? t_worker_index : -1;
+}
+
+//与Stop配对：先登记再检查状态，Stop先改状态再等登记数归0，两边至少有一方看到对方
+bool ThreadPool::TryPush(PoolTask* task)
+{
+    m_push_num.fetch_add(1, std::memory_order_seq_cst);
+    bool running = (m_state.load(std::memory_order_seq_cst) == STATE_RUNNING);
+    if(running)
+    {
+        Push(task);
+    }
+    m_push_num.fetch_sub(1, std::memory_order_release);
+    return running;
+}
+
+void ThreadPool::Push(PoolTask* task)
+{
+    int index = WorkerIndex();
+    if(index >= 0)
+    {
+        m_workers[index]->deque.Push(task);
+    }
+    else
+    {
+        m_queue->Push(task);
+    }
+    Notify();
+}
+
+//先找自己的deque，再找外部提交的队列，最后从随机位置开始依次窃取
+PoolTask* ThreadPool::FindTask(Worker* worker)
+{
+    PoolTask* task;
+    if(worker != nullptr)
+    {
+        task = worker->deque.Pop();
+        if(task != nullptr)
+        {
+            return task;
+        }
+    }
+
+    if(m_queue->TryPop(task))
+    {
+        return task;
+    }
+
+    size_t num = m_workers.size();
+    size_t start = 0;
+    if(worker != nullptr)
+    {
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 7;
+        worker->seed ^= worker->seed << 17;
+        start = worker->seed % num;
+    }
+    for(size_t i = 0; i < num; ++i)
+    {
+        Worker* victim = m_workers[(start + i) % num];
+        if(victim == worker)
+        {
+            continue;
+        }
+        task = victim->deque.Steal();
+        if(task != nullptr)
+        {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool ThreadPool::HasTask() const
+{
+    if(m_queue->Size() != 0)
+    {
+        return true;
+    }
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        if(!m_workers[i]->deque.Empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//先登记为空闲再检查任务，与Notify中先放入任务再检查空闲数配对，不会丢失唤醒
+void ThreadPool::Park()
+{
+    uint32_t epoch = m_wake_epoch.load(std::memory_order_acquire);
+    m_idle_num.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(!HasTask() && !m_stopping.load(std::memory_order_relaxed))
+    {
+        futex_wait(&m_wake_epoch, epoch, -1);
+    }
+    m_idle_num.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ThreadPool::Notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_idle_num.load(std::memory_order_relaxed) != 0)
+    {
+        m_wake_epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&m_wake_epoch, 1);
+    }
+}
+
+void ThreadPool::Wait(std::atomic<uint32_t>& done)
+{
+    int index = WorkerIndex();
+    Worker* worker = (index >= 0) ? m_workers[index] : nullptr;
+
+    while(done.load(std::memory_order_acquire) != 1)
+    {
+        if(worker != nullptr)
+        {
+            PoolTask* task = FindTask(worker);
+            if(task != nullptr)
+            {
+                task->Run();
+                delete task;
+                continue;
+            }
+        }
+
+        uint32_t expected = 0;
+        if(done.compare_exchange_strong(expected, 2, std::memory_order_acq_rel) || expected == 2)
+        {
+            //工作线程只短暂睡眠，醒来后继续帮助执行新任务
+            futex_wait(&done, 2, (worker != nullptr) ? 1 : -1);
+        }
+    }
+}
+
+void ThreadPool::WorkerFunc(int index, void* arg)
+{
+    ThreadPool* pool = (ThreadPool*)arg;
+    t_pool = pool;
+    t_worker_index = index;
+    pool->Work(index);
+    t_pool = nullptr;
+    t_worker_index = -1;
+}
+
+void ThreadPool::Work(int index)
+{
+    Worker* worker = m_workers[index];
+    uint32_t idle_cnt = 0;
+    for(;;)
+    {
+        PoolTask* task = FindTask(worker);
+        if(task != nullptr)
+        {
+            task->Run();
+            delete task;
+            idle_cnt = 0;
+            continue;
+        }
+
+        //停止时所有队列已空，其他线程执行中产生的新任务在它自己的deque中，由它自己执行
+        if(m_stopping.load(std::memory_order_acquire))
+        {
+            break;
+        }
+        if(++idle_cnt < SPIN_NUM)
+        {
+            Thread::Yield();
+            continue;
+        }
+        Park();
+        idle_cnt = 0;
+    }
+}
+
+static std::mutex s_shared_options_mutex;
+
+static ThreadOptions DefaultSharedPoolOptions()
+{
+    ThreadOptions options;
+    options.name = "xfpool";
+    return options;
+}
+
+//由s_shared_options_mutex保护
+static ThreadOptions& SharedPoolOptions()
+{
+    static ThreadOptions s_options = DefaultSharedPoolOptions();
+    return s_options;
+}
+
+void SetSharedThreadPoolOptions(const ThreadOptions& options)
+{
+    std::lock_guard<std::mutex> lock(s_shared_options_mutex);
+    SharedPoolOptions() = options;
+}
+
+static bool StartSharedThreadPool(ThreadPool& pool)
+{
+    ThreadOptions options;
+    {
+        std::lock_guard<std::mutex> lock(s_shared_options_mutex);
+        options = SharedPoolOptions();
+    }
+    return pool.Start(-1, 4096, options);
+}
+
+ThreadPool& GetSharedThreadPool()
+{
+    static ThreadPool s_pool;
+    static bool s_started = StartSharedThreadPool(s_pool);
+    (void)s_started;
+    return s_pool;
+}
+
+}
+
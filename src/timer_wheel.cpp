@@ -0,0 +1,393 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include "xfutil/timer_wheel.h"
+
+namespace xfutil
+{
+
+TimerWheel::TimerWheel(ThreadPool* pool/* = nullptr*/)
+    : m_pool(pool)
+{
+    for(uint32_t i = 0; i < ROOT_SIZE; ++i)
+    {
+        ListInit(&m_root[i]);
+    }
+    for(uint32_t level = 0; level < LEVEL_NUM - 1; ++level)
+    {
+        for(uint32_t i = 0; i < LEVEL_SIZE; ++i)
+        {
+            ListInit(&m_levels[level][i]);
+        }
+    }
+    m_current = GetTickMilliTime();
+    m_count = 0;
+    m_started = false;
+    m_stopping = false;
+    m_wake_time = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    Stop();
+}
+
+TimerWheel::TimerNode* TimerWheel::NodeAt(uint32_t index)
+{
+    return &m_node_blocks[index >> NODE_BLOCK_BITS][index & (NODE_BLOCK_SIZE - 1)];
+}
+
+uint64_t TimerWheel::TimerId(const TimerNode* node) const
+{
+    return ((uint64_t)node->generation << 32) | ((uint64_t)node->index + 1);
+}
+
+TimerWheel::TimerNode* TimerWheel::Find_(uint64_t timer_id)
+{
+    uint32_t index = (uint32_t)timer_id - 1;
+    if((uint32_t)timer_id == 0 || index >= m_node_blocks.size() * NODE_BLOCK_SIZE)
+    {
+        return nullptr;
+    }
+    TimerNode* node = NodeAt(index);
+    if(node->cb == nullptr || node->generation != (uint32_t)(timer_id >> 32))
+    {
+        return nullptr;
+    }
+    return node;
+}
+
+TimerWheel::TimerNode* TimerWheel::NewNode_()
+{
+    if(m_free_nodes.empty())
+    {
+        uint32_t base = (uint32_t)m_node_blocks.size() * NODE_BLOCK_SIZE;
+        TimerNode* block = new TimerNode[NODE_BLOCK_SIZE];
+        m_node_blocks.push_back(std::unique_ptr<TimerNode[]>(block));
+        for(uint32_t i = NODE_BLOCK_SIZE; i > 0; --i)
+        {
+            block[i - 1].index = base + i - 1;
+            block[i - 1].generation = 0;
+            block[i - 1].cb = nullptr;
+            m_free_nodes.push_back(base + i - 1);
+        }
+    }
+    TimerNode* node = NodeAt(m_free_nodes.back());
+    m_free_nodes.pop_back();
+    return node;
+}
+
+void TimerWheel::FreeNode_(TimerNode* node)
+{
+    node->cb = nullptr;
+    ++node->generation;
+    m_free_nodes.push_back(node->index);
+}
+
+//按到期时间与当前时间的差放入对应层的槽
+void TimerWheel::Add_(TimerNode* node)
+{
+    if(node->expire < m_current)
+    {
+        node->expire = m_current;
+    }
+    uint64_t delay = node->expire - m_current;
+    if(delay > MAX_DELAY)
+    {
+        delay = MAX_DELAY;
+        node->expire = m_current + MAX_DELAY;
+    }
+
+    List* slot;
+    if(delay < ROOT_SIZE)
+    {
+        slot = &m_root[node->expire & ROOT_MASK];
+    }
+    else
+    {
+        uint32_t level = 0;
+        uint32_t shift = ROOT_BITS + LEVEL_BITS;
+        while(delay >= (1ULL << shift))
+        {
+            ++level;
+            shift += LEVEL_BITS;
+        }
+        slot = &m_levels[level][(node->expire >> (shift - LEVEL_BITS)) & LEVEL_MASK];
+    }
+    ListAddTail(&node->link, slot);
+}
+
+//把list整体摘到to，list变为空
+static inline void ListMove(List* list, List* to)
+{
+    ListInit(to);
+    if(!ListEmtpy(list))
+    {
+        ListInsert_(to, list->prev, list->next);
+        ListInit(list);
+    }
+}
+
+//把上层一个槽中的定时器重新分配到下层，返回该槽下标，为0时需继续处理更上一层
+uint32_t TimerWheel::Cascade_(uint32_t level, uint32_t index)
+{
+    List list;
+    ListMove(&m_levels[level][index], &list);
+    while(!ListEmtpy(&list))
+    {
+        TimerNode* node = (TimerNode*)ListHead(&list);
+        ListDelete(&node->link);
+        Add_(node);
+    }
+    return index;
+}
+
+//推进m_current一毫秒，第0层转完一圈时先从上层下移
+void TimerWheel::Tick_()
+{
+    if((m_current & ROOT_MASK) == 0)
+    {
+        uint32_t shift = ROOT_BITS;
+        for(uint32_t level = 0; level < LEVEL_NUM - 1; ++level)
+        {
+            if(Cascade_(level, (uint32_t)((m_current >> shift) & LEVEL_MASK)) != 0)
+            {
+                break;
+            }
+            shift += LEVEL_BITS;
+        }
+    }
+    ++m_current;
+}
+
+//取出到期的定时器：一次性的释放节点，周期的重新放入
+void TimerWheel::Expire_(uint64_t now_ms, List* list, std::vector<Expired>& expired)
+{
+    while(!ListEmtpy(list))
+    {
+        TimerNode* node = (TimerNode*)ListHead(list);
+        ListDelete(&node->link);
+
+        Expired e;
+        e.timer_id = TimerId(node);
+        e.cb = node->cb;
+        e.arg = node->arg;
+        expired.push_back(e);
+
+        if(node->interval != 0)
+        {
+            node->expire += node->interval;
+            if(node->expire <= now_ms)
+            {
+                node->expire = now_ms + node->interval;
+            }
+            Add_(node);
+        }
+        else
+        {
+            FreeNode_(node);
+            --m_count;
+        }
+    }
+}
+
+uint64_t TimerWheel::Schedule(uint32_t delay_ms, TimerCallback cb, void* arg/* = nullptr*/, uint32_t interval_ms/* = 0*/)
+{
+    uint64_t now = GetTickMilliTime();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_count == 0 && m_current < now)
+    {
+        //空闲时没有推进，直接跳到当前时间，避免Advance逐毫秒追赶
+        m_current = now;
+    }
+
+    TimerNode* node = NewNode_();
+    node->expire = now + delay_ms;
+    node->interval = interval_ms;
+    node->cb = cb;
+    node->arg = arg;
+    Add_(node);
+    ++m_count;
+
+    if(m_started && node->expire < m_wake_time)
+    {
+        m_cond.notify_one();
+    }
+    return TimerId(node);
+}
+
+bool TimerWheel::Cancel(uint64_t timer_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    TimerNode* node = Find_(timer_id);
+    if(node == nullptr)
+    {
+        return false;
+    }
+    ListDelete(&node->link);
+    FreeNode_(node);
+    --m_count;
+    return true;
+}
+
+size_t TimerWheel::Advance(uint64_t now_ms)
+{
+    std::vector<Expired> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_count == 0)
+        {
+            if(m_current <= now_ms)
+            {
+                m_current = now_ms + 1;
+            }
+            return 0;
+        }
+
+        while(m_current <= now_ms)
+        {
+            //没有定时器时直接跳到当前时间
+            if(m_count == 0)
+            {
+                m_current = now_ms + 1;
+                break;
+            }
+            //第0层的空槽直接跳过，只在非空槽和整圈边界（需要从上层下移）停下
+            List* slot = &m_root[m_current & ROOT_MASK];
+            if((m_current & ROOT_MASK) != 0 && ListEmtpy(slot))
+            {
+                ++m_current;
+                continue;
+            }
+            Tick_();
+
+            //先整体摘下，周期定时器重新放入时不会被本轮再次取出
+            List list;
+            ListMove(slot, &list);
+            Expire_(now_ms, &list, expired);
+        }
+    }
+
+    //回调在锁外执行，回调中可以Schedule/Cancel
+    for(size_t i = 0; i < expired.size(); ++i)
+    {
+        const Expired& e = expired[i];
+        if(m_pool != nullptr)
+        {
+            m_pool->Submit([e]() { e.cb(e.timer_id, e.arg); });
+        }
+        else
+        {
+            e.cb(e.timer_id, e.arg);
+        }
+    }
+    return expired.size();
+}
+
+//先找第0层最近的非空槽；第0层转完一圈时需要从上层下移，也要在那一刻醒来
+int TimerWheel::NextTimeout_(uint64_t now_ms)
+{
+    if(m_count == 0)
+    {
+        return -1;
+    }
+
+    uint64_t next = m_current;
+    for(uint32_t i = 0; i < ROOT_SIZE; ++i, ++next)
+    {
+        if((next & ROOT_MASK) == 0 || !ListEmtpy(&m_root[next & ROOT_MASK]))
+        {
+            break;
+        }
+    }
+    return (next > now_ms) ? (int)(next - now_ms) : 0;
+}
+
+int TimerWheel::NextTimeout()
+{
+    uint64_t now = GetTickMilliTime();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return NextTimeout_(now);
+}
+
+bool TimerWheel::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_started)
+    {
+        return false;
+    }
+    m_stopping = false;
+    m_started = true;
+
+    ThreadOptions options;
+    options.name = "timer";
+    m_thread.Start(ThreadFunc, this, options);
+    return true;
+}
+
+void TimerWheel::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_started)
+        {
+            return;
+        }
+        m_stopping = true;
+        m_cond.notify_one();
+    }
+    m_thread.Join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_started = false;
+}
+
+void TimerWheel::ThreadFunc(void* arg)
+{
+    TimerWheel* wheel = (TimerWheel*)arg;
+    wheel->Run();
+}
+
+void TimerWheel::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stopping)
+    {
+        uint64_t now = GetTickMilliTime();
+        int timeout = NextTimeout_(now);
+        if(timeout < 0)
+        {
+            m_wake_time = (uint64_t)-1;
+            m_cond.wait(lock);
+            continue;
+        }
+        if(timeout > 0)
+        {
+            m_wake_time = now + timeout;
+            m_cond.wait_for(lock, std::chrono::milliseconds(timeout));
+            continue;
+        }
+
+        m_wake_time = 0;
+        lock.unlock();
+        Advance(now);
+        lock.lock();
+    }
+}
+
+}
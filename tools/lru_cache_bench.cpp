@@ -0,0 +1,382 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "xfutil.h"
+
+using namespace xfutil;
+
+//LruCache微基准：输出每次操作的纳秒数，多线程场景输出总吞吐折算的纳秒数
+//基础场景同时跑一遍改为侵入式链表之前的实现（baseline），两列直接对比
+//用法: lru_cache_bench [key_num] [op_num]
+
+static inline uint64_t NowNanoTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline uint64_t NextRandom(uint64_t& seed)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static void Report(const char* name, uint64_t op_num, uint64_t elapsed_ns)
+{
+    printf("%-24s %10lu ops %8.1f ns/op\n", name, op_num, (double)elapsed_ns / op_num);
+}
+
+//改为侵入式链表之前的LruCache：std::list + unordered_map，命中时复制节点并重新插入链表
+//只补上了提升到hot时漏加的hot大小，其余与原实现一致
+template<class Key, class Value>
+class BaselineLruCache
+{
+    struct Node
+    {
+        Key key;
+        Value value;
+        size_t value_size;
+    };
+    typedef typename std::list<Node>::iterator NodeIterator;
+
+public:
+    explicit BaselineLruCache(size_t max_size)
+        : m_max_hot_size(max_size*0.6), m_max_cold_size(max_size-m_max_hot_size), m_hot_size(0), m_cold_size(0)
+    {}
+
+public:
+    void Add(const Key& key, const Value& value, size_t value_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ReserveColdList(value_size);
+        if(m_cold_map.find(key) == m_cold_map.end())
+        {
+            Node node = {key, value, value_size};
+            m_cold_list.push_front(node);
+            m_cold_map[key] = m_cold_list.begin();
+            m_cold_size += value_size;
+        }
+    }
+
+    bool Get(const Key& key, Value& value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_hot_map.find(key);
+        if(it != m_hot_map.end())
+        {
+            value = it->second->value;
+            Node node = *it->second;
+            m_hot_list.erase(it->second);
+            m_hot_list.push_front(node);
+            it->second = m_hot_list.begin();
+            return true;
+        }
+        auto it2 = m_cold_map.find(key);
+        if(it2 != m_cold_map.end())
+        {
+            value = it2->second->value;
+            Node node = *it2->second;
+            m_cold_size -= node.value_size;
+            m_cold_list.erase(it2->second);
+            m_cold_map.erase(it2);
+
+            ReserveHotList(node.value_size);
+            m_hot_list.push_front(node);
+            m_hot_map[node.key] = m_hot_list.begin();
+            m_hot_size += node.value_size;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    void ReserveColdList(size_t value_size)
+    {
+        while(!m_cold_list.empty() && m_cold_size + value_size > m_max_cold_size)
+        {
+            m_cold_size -= m_cold_list.back().value_size;
+            m_cold_map.erase(m_cold_list.back().key);
+            m_cold_list.pop_back();
+        }
+    }
+
+    void ReserveHotList(size_t value_size)
+    {
+        while(!m_hot_list.empty() && m_hot_size + value_size > m_max_hot_size)
+        {
+            Node node = m_hot_list.back();
+            m_hot_size -= node.value_size;
+            m_hot_map.erase(node.key);
+            m_hot_list.pop_back();
+
+            m_cold_size += node.value_size;
+            m_cold_list.push_front(node);
+            m_cold_map[node.key] = m_cold_list.begin();
+        }
+    }
+
+private:
+    const size_t m_max_hot_size;
+    const size_t m_max_cold_size;
+    std::mutex m_mutex;
+
+    size_t m_hot_size;
+    std::list<Node> m_hot_list;
+    std::unordered_map<Key, NodeIterator> m_hot_map;
+
+    size_t m_cold_size;
+    std::list<Node> m_cold_list;
+    std::unordered_map<Key, NodeIterator> m_cold_map;
+};
+
+//命中、未命中、淘汰和混合四个基础场景，name_prefix区分实现
+template<class Cache>
+static uint64_t RunCore(const std::string& name_prefix, const std::vector<uint64_t>& keys, uint64_t key_num)
+{
+    uint64_t op_num = keys.size();
+    uint64_t found = 0;
+    uint64_t value = 0;
+
+    //全部命中：容量足够容纳所有key，预热后只测Get
+    {
+        Cache cache(key_num * 2);
+        for(uint64_t i = 0; i < key_num; ++i)
+        {
+            cache.Add(i, i, 1);
+        }
+        for(uint64_t i = 0; i < key_num; ++i)
+        {
+            cache.Get(i, value);
+        }
+
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            found += cache.Get(keys[i], value);
+        }
+        Report((name_prefix + "get(hit)").c_str(), op_num, NowNanoTime() - start);
+    }
+
+    //全部未命中
+    {
+        Cache cache(key_num);
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            found += cache.Get(keys[i], value);
+        }
+        Report((name_prefix + "get(miss)").c_str(), op_num, NowNanoTime() - start);
+    }
+
+    //持续插入新key，触发淘汰
+    {
+        Cache cache(key_num / 2);
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            cache.Add(i, i, 1);
+        }
+        Report((name_prefix + "add(evict)").c_str(), op_num, NowNanoTime() - start);
+    }
+
+    //容量为key数量的一半：get未命中则add
+    {
+        Cache cache(key_num / 2);
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            if(cache.Get(keys[i], value))
+            {
+                ++found;
+            }
+            else
+            {
+                cache.Add(keys[i], keys[i], 1);
+            }
+        }
+        Report((name_prefix + "get-or-add(50%)").c_str(), op_num, NowNanoTime() - start);
+    }
+    return found;
+}
+
+//多线程并发Get（全部命中）：各线程从不同偏移遍历同一组key，按墙钟时间和总操作数折算
+template<class Cache>
+static uint64_t RunParallelGet(const char* name, const std::vector<uint64_t>& keys, uint64_t key_num, size_t thread_num)
+{
+    Cache cache(key_num * 2);
+    for(uint64_t i = 0; i < key_num; ++i)
+    {
+        cache.Add(i, i, 1);
+    }
+
+    uint64_t op_num = keys.size();
+    std::vector<uint64_t> found(thread_num, 0);
+    std::vector<std::thread> threads;
+
+    uint64_t start = NowNanoTime();
+    for(size_t t = 0; t < thread_num; ++t)
+    {
+        threads.emplace_back([&cache, &keys, &found, op_num, thread_num, t]() {
+            uint64_t value = 0;
+            uint64_t count = 0;
+            for(uint64_t i = 0; i < op_num; ++i)
+            {
+                count += cache.Get(keys[(i + t * op_num / thread_num) % op_num], value);
+            }
+            found[t] = count;
+        });
+    }
+    for(size_t t = 0; t < thread_num; ++t)
+    {
+        threads[t].join();
+    }
+    uint64_t elapsed = NowNanoTime() - start;
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s x%zu", name, thread_num);
+    Report(buf, op_num * thread_num, elapsed);
+
+    uint64_t sum = 0;
+    for(size_t t = 0; t < thread_num; ++t)
+    {
+        sum += found[t];
+    }
+    return sum;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t key_num = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100000;
+    uint64_t op_num = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 5000000;
+
+    std::vector<uint64_t> keys(op_num);
+    uint64_t seed = 88172645463325252ULL;
+    for(uint64_t i = 0; i < op_num; ++i)
+    {
+        keys[i] = NextRandom(seed) % key_num;
+    }
+
+    uint64_t found = 0;
+    uint64_t value = 0;
+
+    found += RunCore<BaselineLruCache<uint64_t, uint64_t>>("baseline ", keys, key_num);
+    found += RunCore<LruCache<uint64_t, uint64_t>>("", keys, key_num);
+
+    //CLOCK淘汰：命中只置访问位
+    {
+        ClockCache<uint64_t, uint64_t> cache(key_num * 2);
+        for(uint64_t i = 0; i < key_num; ++i)
+        {
+            cache.Add(i, i, 1);
+        }
+
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            found += cache.Get(keys[i], value);
+        }
+        Report("clock get(hit)", op_num, NowNanoTime() - start);
+    }
+
+    //并发Get随线程数的扩展：ClockCache分片读锁 vs LruCache单锁
+    static const size_t thread_nums[] = {1, 2, 4, 8};
+    for(size_t n : thread_nums)
+    {
+        found += RunParallelGet<ClockCache<uint64_t, uint64_t>>("clock get(hit)", keys, key_num, n);
+    }
+    for(size_t n : thread_nums)
+    {
+        found += RunParallelGet<LruCache<uint64_t, uint64_t>>("get(hit)", keys, key_num, n);
+    }
+
+    //4KB的value：Get复制value，Lookup只返回句柄
+    {
+        uint64_t big_key_num = MIN(key_num, (uint64_t)10000);
+        LruCache<uint64_t, std::string> cache(big_key_num * 2);
+        for(uint64_t i = 0; i < big_key_num; ++i)
+        {
+            cache.Add(i, std::string(4096, 'x'), 1);
+        }
+
+        std::string big_value;
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            found += cache.Get(keys[i] % big_key_num, big_value);
+        }
+        Report("get(hit,4KB)", op_num, NowNanoTime() - start);
+
+        start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            const LruCache<uint64_t, std::string>::Handle* handle = cache.Lookup(keys[i] % big_key_num);
+            if(handle != nullptr)
+            {
+                found += handle->GetValue().size();
+                cache.Release(handle);
+            }
+        }
+        Report("lookup(hit,4KB)", op_num, NowNanoTime() - start);
+    }
+
+    //字符串key：两者都直接用已有的key查找，比较std::string与StrView在hash和比较上的差异
+    {
+        std::vector<std::string> str_keys(key_num);
+        for(uint64_t i = 0; i < key_num; ++i)
+        {
+            str_keys[i] = "user:session:" + std::to_string(i);
+        }
+
+        LruCache<std::string, uint64_t> str_cache(key_num * 2);
+        LruCache<StrView, uint64_t> view_cache(key_num * 2);
+        for(uint64_t i = 0; i < key_num; ++i)
+        {
+            StrView key;
+            key.Set(str_keys[i].data(), str_keys[i].size());
+            str_cache.Add(str_keys[i], i, 1);
+            view_cache.Add(key, i, 1);
+        }
+
+        uint64_t start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            found += str_cache.Get(str_keys[keys[i]], value);
+        }
+        Report("get(hit,string key)", op_num, NowNanoTime() - start);
+
+        start = NowNanoTime();
+        for(uint64_t i = 0; i < op_num; ++i)
+        {
+            StrView key;
+            key.Set(str_keys[keys[i]].data(), str_keys[keys[i]].size());
+            found += view_cache.Get(key, value);
+        }
+        Report("get(hit,StrView key)", op_num, NowNanoTime() - start);
+    }
+
+    printf("found: %lu\n", found);
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include "xfutil.h"
+
+using namespace xfutil;
+
+//按访问记录回放，比较各淘汰策略的命中率
+//用法: lru_trace_replay <trace_file> <max_size>
+//trace文件每行一次访问: key [size]，size缺省为1；未命中时按size Add
+
+struct TraceRecord
+{
+    uint64_t key;
+    size_t size;
+};
+
+static bool ReadTrace(const char* path, std::vector<TraceRecord>& records)
+{
+    FILE* fp = fopen(path, "r");
+    if(fp == nullptr)
+    {
+        return false;
+    }
+
+    char line[1024];
+    while(fgets(line, sizeof(line), fp) != nullptr)
+    {
+        char* end = nullptr;
+        TraceRecord record;
+        record.key = strtoull(line, &end, 10);
+        if(end == line)
+        {
+            continue;
+        }
+        record.size = strtoul(end, nullptr, 10);
+        if(record.size == 0)
+        {
+            record.size = 1;
+        }
+        records.push_back(record);
+    }
+    fclose(fp);
+    return true;
+}
+
+template<template<class> class Policy>
+static void Replay(const char* name, const std::vector<TraceRecord>& records, size_t max_size, size_t admission_entry_num)
+{
+    LruCache<uint64_t, uint64_t, LruHash<uint64_t>, Policy> cache(max_size, admission_entry_num);
+
+    uint64_t hit_bytes = 0;
+    uint64_t total_bytes = 0;
+    uint64_t value;
+    for(size_t i = 0; i < records.size(); ++i)
+    {
+        const TraceRecord& record = records[i];
+        total_bytes += record.size;
+        if(cache.Get(record.key, value))
+        {
+            hit_bytes += record.size;
+        }
+        else
+        {
+            cache.Add(record.key, record.key, record.size);
+        }
+    }
+
+    LruCacheStats stats = cache.Stats();
+    printf("%-16s hit %6.2f%%  byte hit %6.2f%%  evict %10lu\n", name, stats.HitRatio() * 100,
+        (total_bytes != 0) ? (double)hit_bytes * 100 / total_bytes : 0.0, stats.evict_count);
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: %s <trace_file> <max_size>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TraceRecord> records;
+    if(!ReadTrace(argv[1], records))
+    {
+        fprintf(stderr, "failed to read trace file: %s\n", argv[1]);
+        return 1;
+    }
+    size_t max_size = strtoull(argv[2], nullptr, 10);
+    printf("%lu records, max_size %lu\n", records.size(), max_size);
+
+    Replay<LruSegmentPolicy>("segment", records, max_size, 0);
+    Replay<LruSegmentPolicy>("segment+tinylfu", records, max_size, records.size());
+    Replay<LruArcPolicy>("arc", records, max_size, 0);
+    Replay<LruGdsfPolicy>("gdsf", records, max_size, 0);
+	return 0;
+}
+
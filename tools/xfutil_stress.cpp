@@ -0,0 +1,856 @@
+/*************************************************************************
+Copyright (C) 2023 The xfutil Authors. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***************************************************************************/
+
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include "xfutil.h"
+
+using namespace xfutil;
+
+//并发队列、线程池和LruCache持久化的压力测试，任一检查失败时返回1
+//用法: xfutil_stress [data_dir] [round]
+
+static int g_failed = 0;
+
+static void Check(bool cond, const char* name)
+{
+    if(!cond)
+    {
+        printf("FAILED: %s\n", name);
+        ++g_failed;
+    }
+}
+
+//多个生产者、多个消费者：每个值恰好消费一次，同一生产者的值在同一消费者处递增
+static void TestRingQueue(uint64_t num)
+{
+    const int PRODUCER_NUM = 4;
+    const int CONSUMER_NUM = 4;
+    RingQueue<uint64_t> queue(256);
+    std::atomic<uint64_t> pop_num(0);
+    std::atomic<uint64_t> pop_sum(0);
+    std::atomic<int> disorder(0);
+
+    std::vector<std::thread> threads;
+    for(int p = 0; p < PRODUCER_NUM; ++p)
+    {
+        threads.emplace_back([&, p]() {
+            for(uint64_t i = 0; i < num; ++i)
+            {
+                uint64_t v = ((uint64_t)p << 32) | i;
+                if((i & 1) == 0)
+                {
+                    queue.Push(v);
+                }
+                else
+                {
+                    while(!queue.TryPush(v))
+                    {
+                        Thread::Yield();
+                    }
+                }
+            }
+        });
+    }
+    for(int c = 0; c < CONSUMER_NUM; ++c)
+    {
+        threads.emplace_back([&]() {
+            std::vector<int64_t> last(PRODUCER_NUM, -1);
+            for(;;)
+            {
+                uint64_t v;
+                if(!queue.Pop(v, 10))
+                {
+                    if(pop_num.load() >= num * PRODUCER_NUM)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+                int p = (int)(v >> 32);
+                int64_t seq = (int64_t)(v & 0xFFFFFFFF);
+                if(seq <= last[p])
+                {
+                    ++disorder;
+                }
+                last[p] = seq;
+                pop_sum += seq;
+                ++pop_num;
+            }
+        });
+    }
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    Check(pop_num.load() == num * PRODUCER_NUM, "RingQueue pop count");
+    Check(pop_sum.load() == PRODUCER_NUM * (num * (num - 1) / 2), "RingQueue pop sum");
+    Check(disorder.load() == 0, "RingQueue per-producer order");
+    Check(queue.Size() == 0, "RingQueue empty");
+}
+
+//只能移动的元素：Push/Pop都移动，队列满时写入失败不移走参数
+static void TestRingQueueMove()
+{
+    RingQueue<std::unique_ptr<uint64_t>> queue(2);
+    std::unique_ptr<uint64_t> v(new uint64_t(1));
+    queue.Push(std::move(v));
+    Check(!v, "RingQueue move push");
+
+    v.reset(new uint64_t(2));
+    Check(queue.TryPush(std::move(v)) && !v, "RingQueue move try push");
+
+    v.reset(new uint64_t(3));
+    Check(!queue.TryPush(std::move(v)) && v && *v == 3, "RingQueue full try push keeps value");
+    Check(!queue.Push(std::move(v), 1) && v && *v == 3, "RingQueue full timed push keeps value");
+
+    std::unique_ptr<uint64_t> out;
+    Check(queue.TryPop(out) && out && *out == 1, "RingQueue move pop");
+    Check(queue.Push(std::move(v), 1) && !v, "RingQueue timed move push");
+    queue.Pop(out);
+    Check(out && *out == 2, "RingQueue move pop order");
+}
+
+//SpscRingQueue只能移动的元素：批量写入只移走写入成功的部分
+static void TestSpscRingQueueMove()
+{
+    SpscRingQueue<std::unique_ptr<uint64_t>> queue(4);
+    std::unique_ptr<uint64_t> items[6];
+    for(uint64_t i = 0; i < 6; ++i)
+    {
+        items[i].reset(new uint64_t(i));
+    }
+    Check(queue.PushBatchMove(items, 6) == 4 && !items[3] && items[4] && items[5], "SpscRingQueue move push batch");
+    Check(!queue.TryPush(std::move(items[4])) && items[4], "SpscRingQueue full try push keeps value");
+    Check(!queue.Push(std::move(items[4]), 1) && items[4], "SpscRingQueue full timed push keeps value");
+
+    std::unique_ptr<uint64_t> out[4];
+    Check(queue.PopBatch(out, 4) == 4 && *out[0] == 0 && *out[3] == 3, "SpscRingQueue move pop batch");
+    queue.Push(std::move(items[4]));
+    Check(queue.TryPush(std::move(items[5])) && !items[4] && !items[5], "SpscRingQueue move push");
+    queue.Pop(out[0]);
+    Check(out[0] && *out[0] == 4, "SpscRingQueue move pop");
+}
+
+//单生产者单消费者，混用单个和批量接口，消费顺序必须与生产顺序一致
+static void TestSpscRingQueue(uint64_t num)
+{
+    SpscRingQueue<uint64_t> queue(128);
+    std::atomic<int> disorder(0);
+
+    std::thread producer([&]() {
+        uint64_t batch[16];
+        uint64_t i = 0;
+        while(i < num)
+        {
+            if((i & 255) < 128)
+            {
+                queue.Push(i++);
+                continue;
+            }
+            size_t n = 0;
+            for(; n < 16 && i + n < num; ++n)
+            {
+                batch[n] = i + n;
+            }
+            size_t pushed = queue.PushBatch(batch, n);
+            i += pushed;
+            if(pushed == 0)
+            {
+                Thread::Yield();
+            }
+        }
+    });
+
+    uint64_t expected = 0;
+    uint64_t batch[32];
+    while(expected < num)
+    {
+        if((expected & 1023) < 512)
+        {
+            uint64_t v;
+            queue.Pop(v);
+            if(v != expected)
+            {
+                ++disorder;
+            }
+            ++expected;
+            continue;
+        }
+        size_t n = queue.PopBatch(batch, 32);
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(batch[i] != expected)
+            {
+                ++disorder;
+            }
+            ++expected;
+        }
+        if(n == 0)
+        {
+            Thread::Yield();
+        }
+    }
+    producer.join();
+
+    Check(disorder.load() == 0, "SpscRingQueue order");
+    uint64_t v;
+    Check(!queue.TryPop(v), "SpscRingQueue empty");
+}
+
+static uint64_t ParallelSum(ThreadPool& pool, uint64_t begin, uint64_t end)
+{
+    if(end - begin <= 64)
+    {
+        uint64_t sum = 0;
+        for(uint64_t i = begin; i < end; ++i)
+        {
+            sum += i;
+        }
+        return sum;
+    }
+    uint64_t mid = begin + (end - begin) / 2;
+    TaskFuture<uint64_t> left = pool.Submit([&pool, begin, mid]() {
+        return ParallelSum(pool, begin, mid);
+    });
+    uint64_t right = ParallelSum(pool, mid, end);
+    return left.Get() + right;
+}
+
+static void TestThreadPool(int round)
+{
+    //工作线程中递归Submit，空闲线程靠窃取分担
+    {
+        ThreadPool pool;
+        pool.Start(4, 64);
+        uint64_t num = 1 << 20;
+        Check(ParallelSum(pool, 0, num) == num * (num - 1) / 2, "ThreadPool steal sum");
+
+        //工作线程中Stop直接返回，不会死锁
+        pool.Submit([&pool]() {
+            pool.Stop();
+        }).Get();
+        Check(pool.Size() == 4, "ThreadPool Stop in worker");
+        pool.Stop();
+    }
+
+    //外部线程并发Submit时Stop：每个任务都执行一次，每个future都完成
+    for(int r = 0; r < round; ++r)
+    {
+        ThreadPool pool;
+        pool.Start(4, 64);
+
+        const int SUBMITTER_NUM = 4;
+        const int TASK_NUM = 2000;
+        std::atomic<int> run_num(0);
+        std::atomic<int> ready_num(0);
+        std::vector<std::thread> submitters;
+        for(int s = 0; s < SUBMITTER_NUM; ++s)
+        {
+            submitters.emplace_back([&]() {
+                std::vector<TaskFuture<void>> futures;
+                for(int i = 0; i < TASK_NUM; ++i)
+                {
+                    futures.push_back(pool.Submit([&run_num]() {
+                        ++run_num;
+                    }));
+                }
+                for(size_t i = 0; i < futures.size(); ++i)
+                {
+                    futures[i].Wait();
+                    ++ready_num;
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(r * 50));
+        pool.Stop();
+        for(size_t i = 0; i < submitters.size(); ++i)
+        {
+            submitters[i].join();
+        }
+
+        Check(run_num.load() == SUBMITTER_NUM * TASK_NUM, "ThreadPool Submit racing Stop: run");
+        Check(ready_num.load() == SUBMITTER_NUM * TASK_NUM, "ThreadPool Submit racing Stop: future");
+    }
+}
+
+//ClockCache：StrView作key时复制key字节；多线程并发Get时各分片计数之和等于总次数
+static void TestClockCache(uint64_t num)
+{
+    {
+        ClockCache<StrView, uint64_t> cache(1024, 4);
+        std::string key = "clock:key";
+        StrView view;
+        view.Set(key.data(), key.size());
+        cache.Add(view, 1, 1);
+        key[0] = 'x';   //原始key内存被改写后仍能按原值查到
+
+        std::string probe = "clock:key";
+        view.Set(probe.data(), probe.size());
+        uint64_t value = 0;
+        Check(cache.Get(view, value) && value == 1, "ClockCache StrView key");
+        Check(cache.Delete(view) && cache.Size() == 0, "ClockCache StrView delete");
+    }
+
+    const int THREAD_NUM = 4;
+    const uint64_t KEY_NUM = 1000;
+    ClockCache<uint64_t, uint64_t> cache(KEY_NUM * 2);
+    for(uint64_t i = 0; i < KEY_NUM; ++i)
+    {
+        cache.Add(i, i, 1);
+    }
+
+    std::atomic<uint64_t> wrong(0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < THREAD_NUM; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            uint64_t value = 0;
+            for(uint64_t i = 0; i < num; ++i)
+            {
+                //一半命中一半未命中
+                uint64_t key = (i * 7 + t) % (KEY_NUM * 2);
+                bool found = cache.Get(key, value);
+                if(found != (key < KEY_NUM) || (found && value != key))
+                {
+                    ++wrong;
+                }
+            }
+        });
+    }
+    for(size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    Check(wrong.load() == 0, "ClockCache concurrent get");
+    Check(cache.HitCount() + cache.MissCount() == THREAD_NUM * num, "ClockCache counter sum");
+    Check(cache.Size() == KEY_NUM, "ClockCache size");
+}
+
+typedef LruCache<uint64_t, std::string> StrCache;
+typedef ShardedLruCache<uint64_t, std::string> ShardedStrCache;
+
+static void PackEntry(Packer& packer, const uint64_t& key, const std::string& value)
+{
+    StrView view;
+    view.Set(value.data(), value.size());
+    packer.Pack(key);
+    packer.Pack(view);
+}
+
+static bool UnpackEntry(Unpacker& unpacker, uint64_t& key, std::string& value)
+{
+    StrView view;
+    if(!unpacker.Unpack(key) || !unpacker.Unpack(view))
+    {
+        return false;
+    }
+    value.assign(view.data, view.size);
+    return true;
+}
+
+static std::string ValueOf(uint64_t key)
+{
+    return "value:" + std::to_string(key);
+}
+
+//SaveTo/LoadFrom往返：内容一致；分片数变少后旧的分片文件被删除；损坏的文件整体拒绝
+struct FiberTestContext
+{
+    FiberScheduler* sched;
+    int fd;
+    uint32_t file_size;
+    std::atomic<uint32_t> next_id;
+    std::atomic<int> done;
+    std::atomic<int> bad;
+    std::atomic<int> stop_returned;
+};
+
+static inline byte_t FiberFileByte(uint64_t pos)
+{
+    return (byte_t)(pos % 251);
+}
+
+//交替Yield和AwaitRead：aio完成回调与挂起并发，覆盖SUSPENDING/WAKEUP的竞争
+static void FiberReadLoop(void* arg)
+{
+    FiberTestContext* ctx = (FiberTestContext*)arg;
+    uint32_t id = ctx->next_id++;
+    if(id == 0)
+    {
+        ctx->sched->Stop();
+        ++ctx->stop_returned;
+    }
+
+    byte_t buf[64];
+    for(uint32_t i = 0; i < 50; ++i)
+    {
+        uint64_t pos = (id * 7919ULL + i * 4099ULL) % (ctx->file_size - sizeof(buf));
+        if(FiberScheduler::AwaitRead(ctx->fd, pos, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+        {
+            ++ctx->bad;
+            continue;
+        }
+        for(size_t j = 0; j < sizeof(buf); ++j)
+        {
+            if(buf[j] != FiberFileByte(pos + j))
+            {
+                ++ctx->bad;
+                break;
+            }
+        }
+        FiberScheduler::Yield();
+    }
+    ++ctx->done;
+}
+
+//多个调度线程上的协程并发挂起、恢复；协程中调用Stop直接返回
+static void TestFiber(const std::string& dir, int round)
+{
+    const uint32_t FILE_SIZE = 256 * 1024;
+    const int FIBER_NUM = 64;
+
+    std::string path = dir + "/fiber.dat";
+    File file;
+    {
+        std::vector<byte_t> data(FILE_SIZE);
+        for(uint32_t i = 0; i < FILE_SIZE; ++i)
+        {
+            data[i] = FiberFileByte(i);
+        }
+        Check(file.Open(path.c_str(), File::OF_CREATE|File::OF_READWRITE|File::OF_TRUNCATE)
+            && file.Write(data.data(), data.size()) == (int64_t)data.size(), "Fiber test file");
+    }
+
+    Check(aio::Start(2, 4) == 0, "aio Start");
+    for(int r = 0; r < MIN(round, 5); ++r)
+    {
+        FiberTestContext ctx;
+        FiberScheduler sched;
+        ctx.sched = &sched;
+        ctx.fd = file.GetID();
+        ctx.file_size = FILE_SIZE;
+        ctx.next_id = 0;
+        ctx.done = 0;
+        ctx.bad = 0;
+        ctx.stop_returned = 0;
+
+        Check(sched.Start(4, 64 * 1024, 16), "FiberScheduler Start");
+        for(int i = 0; i < FIBER_NUM; ++i)
+        {
+            Check(sched.Spawn(FiberReadLoop, &ctx), "FiberScheduler Spawn");
+        }
+        sched.Stop();
+
+        Check(ctx.stop_returned.load() == 1, "FiberScheduler Stop in fiber returns");
+        Check(ctx.done.load() == FIBER_NUM && sched.FiberNum() == 0, "FiberScheduler all fibers done");
+        Check(ctx.bad.load() == 0, "FiberScheduler AwaitRead data");
+    }
+    //aio须在调度器停止之后停止
+    aio::Stop();
+}
+
+//PriorityBlockingQueue移动入队：满时TryPush和超时的Push不移走参数
+static void TestPriorityQueueMove()
+{
+    PriorityBlockingQueue<std::unique_ptr<uint64_t>> queue(1);
+    std::unique_ptr<uint64_t> v(new uint64_t(1));
+    Check(queue.TryPush(std::move(v), 1) && !v, "PriorityQueue move try push");
+
+    v.reset(new uint64_t(2));
+    Check(!queue.TryPush(std::move(v), 0) && v, "PriorityQueue full try push keeps value");
+    uint64_t start = GetTickMilliTime();
+    Check(!queue.Push(std::move(v), 0, 20) && v, "PriorityQueue timed push keeps value");
+    Check(GetTickMilliTime() - start >= 19, "PriorityQueue timed push waits");
+
+    std::thread popper([&queue]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::unique_ptr<uint64_t> out;
+        queue.Pop(out);
+    });
+    Check(queue.Push(std::move(v), 0, 10000) && !v, "PriorityQueue timed move push");
+    popper.join();
+
+    std::unique_ptr<uint64_t> out;
+    Check(queue.TryPop(out) && out && *out == 2, "PriorityQueue move pop");
+}
+
+static void CountTimer(uint64_t timer_id, void* arg)
+{
+    ++*(int*)arg;
+}
+
+//Schedule内部读时钟：重试到前后读到同一毫秒，得到确切的到期时间
+static uint64_t ScheduleExact(TimerWheel& wheel, uint32_t delay_ms, int* fired, uint32_t interval_ms, uint64_t& expire)
+{
+    for(;;)
+    {
+        uint64_t t0 = GetTickMilliTime();
+        uint64_t timer_id = wheel.Schedule(delay_ms, CountTimer, fired, interval_ms);
+        if(GetTickMilliTime() == t0)
+        {
+            expire = t0 + delay_ms;
+            return timer_id;
+        }
+        wheel.Cancel(timer_id);
+    }
+}
+
+//手动Advance驱动时间轮：层边界上的到期、下移后取消、周期定时器落后
+static void TestTimerWheel()
+{
+    //255在第0层，256和65536分别在第1、2层，需下移后到期
+    static const uint32_t delays[] = {1, 255, 256, 257, 16383, 16384, 65536};
+    for(uint32_t delay : delays)
+    {
+        TimerWheel wheel;
+        int fired = 0;
+        uint64_t expire = 0;
+        ScheduleExact(wheel, delay, &fired, 0, expire);
+
+        char name[64];
+        snprintf(name, sizeof(name), "TimerWheel delay %u not early", delay);
+        Check(wheel.Advance(expire - 1) == 0 && fired == 0, name);
+        snprintf(name, sizeof(name), "TimerWheel delay %u on time", delay);
+        Check(wheel.Advance(expire) == 1 && fired == 1 && wheel.Size() == 0, name);
+    }
+
+    //两个定时器在同一个上层槽中，下移到第0层后取消其中一个，另一个按时到期
+    {
+        TimerWheel wheel;
+        int fired = 0;
+        uint64_t expire = 0, other_expire = 0;
+        uint64_t timer_id = 0;
+        for(uint32_t delay = 700; ; ++delay)
+        {
+            timer_id = ScheduleExact(wheel, delay, &fired, 0, expire);
+            if(expire % 256 != 0 && expire % 256 != 255)
+            {
+                break;
+            }
+            wheel.Cancel(timer_id);
+        }
+        ScheduleExact(wheel, (uint32_t)(expire + 1 - GetTickMilliTime()), &fired, 0, other_expire);
+
+        //到期所在槽的起点处完成下移
+        uint64_t cascade = expire & ~255ULL;
+        Check(wheel.Advance(cascade) == 0 && fired == 0, "TimerWheel cascade without expire");
+        Check(wheel.Cancel(timer_id) && wheel.Size() == 1, "TimerWheel cancel after cascade");
+        Check(!wheel.Cancel(timer_id), "TimerWheel cancel twice");
+        Check(wheel.Advance(other_expire - 1) == 0 && fired == 0, "TimerWheel cancelled timer not fired");
+        Check(wheel.Advance(other_expire) == 1 && fired == 1 && wheel.Size() == 0, "TimerWheel sibling fired after cancel");
+    }
+
+    //周期定时器落后多个周期：只执行一次，下一次从追上的时间起算
+    {
+        TimerWheel wheel;
+        int fired = 0;
+        uint64_t expire = 0;
+        uint64_t timer_id = ScheduleExact(wheel, 10, &fired, 10, expire);
+
+        Check(wheel.Advance(expire + 35) == 1 && fired == 1, "TimerWheel periodic behind fires once");
+        Check(wheel.Advance(expire + 44) == 0 && fired == 1, "TimerWheel periodic skips missed periods");
+        Check(wheel.Advance(expire + 45) == 1 && fired == 2, "TimerWheel periodic resumes");
+        Check(wheel.Advance(expire + 55) == 1 && fired == 3, "TimerWheel periodic on schedule");
+        Check(wheel.Cancel(timer_id) && wheel.Size() == 0, "TimerWheel periodic cancel");
+        Check(wheel.Advance(expire + 100) == 0 && fired == 3, "TimerWheel periodic cancelled");
+    }
+}
+
+//超时清理按100ms的tick进行：同一tick内已超时的旧值不能挡住新值
+static void TestExpireWithinTick()
+{
+    StrCache cache(1000);
+
+    //对齐到tick开头，保证add、超时和再次add都在同一个tick内
+    while(GetTickMilliTime() % 100 >= 40)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    cache.Add(1, "old", 1, 10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    cache.Add(1, "new", 1);
+
+    std::string value;
+    Check(cache.Get(1, value) && value == "new", "LruCache re-add after expire within tick");
+    Check(cache.Stats().expire_count == 1, "LruCache expire count within tick");
+}
+
+static void TestSaveLoad(const std::string& dir)
+{
+    std::string path = dir + "/cache.dat";
+    {
+        StrCache cache(100000);
+        for(uint64_t i = 0; i < 1000; ++i)
+        {
+            cache.Add(i, ValueOf(i), 16, (i % 10 == 0) ? 3600 * 1000 : 0);
+        }
+        Check(cache.SaveTo(path.c_str(), PackEntry), "LruCache SaveTo");
+
+        StrCache loaded(100000);
+        Check(loaded.LoadFrom(path.c_str(), UnpackEntry), "LruCache LoadFrom");
+        Check(loaded.Size() == cache.Size(), "LruCache round trip size");
+        int bad = 0;
+        for(uint64_t i = 0; i < 1000; ++i)
+        {
+            std::string value;
+            if(!loaded.Get(i, value) || value != ValueOf(i))
+            {
+                ++bad;
+            }
+        }
+        Check(bad == 0, "LruCache round trip values");
+    }
+
+    {
+        ShardedStrCache cache(100000, 8);
+        for(uint64_t i = 0; i < 1000; ++i)
+        {
+            cache.Add(i, ValueOf(i), 16);
+        }
+        Check(cache.SaveTo(path.c_str(), PackEntry), "ShardedLruCache SaveTo 8");
+    }
+    {
+        ShardedStrCache cache(100000, 2);
+        for(uint64_t i = 0; i < 100; ++i)
+        {
+            cache.Add(i, ValueOf(i), 16);
+        }
+        Check(cache.SaveTo(path.c_str(), PackEntry), "ShardedLruCache SaveTo 2");
+        Check(File::Exist((path + ".2.1").c_str()) && !File::Exist((path + ".2.2").c_str()), "ShardedLruCache new generation");
+        Check(!File::Exist((path + ".1.0").c_str()), "ShardedLruCache stale shard removed");
+    }
+    {
+        ShardedStrCache cache(100000, 4);
+        Check(cache.LoadFrom(path.c_str(), UnpackEntry), "ShardedLruCache LoadFrom");
+        Check(cache.Size() == 100 * 16, "ShardedLruCache round trip size");
+        std::string value;
+        Check(cache.Get(99, value) && value == ValueOf(99), "ShardedLruCache round trip value");
+        Check(!cache.Get(500, value), "ShardedLruCache no stale entries");
+    }
+
+    //破坏最后一个分片的数据：前面的分片已装入，校验和不对时全部回滚
+    {
+        File file;
+        byte_t b = 0xFF;
+        Check(file.Open((path + ".2.1").c_str(), File::OF_READWRITE) && file.Write(30, &b, 1) == 1, "corrupt shard");
+    }
+    {
+        ShardedStrCache cache(100000, 4);
+        Check(!cache.LoadFrom(path.c_str(), UnpackEntry), "ShardedLruCache rejects corrupt shard");
+        Check(cache.Size() == 0, "ShardedLruCache corrupt load leaves cache empty");
+    }
+
+    //多个chunk的文件：最后一个chunk损坏时已装入的chunk回滚；截断的文件在装入前拒绝
+    std::string big_path = dir + "/big.dat";
+    {
+        StrCache cache(100000000);
+        for(uint64_t i = 0; i < 20000; ++i)
+        {
+            cache.Add(i, std::string(100, 'a' + i % 26), 100);
+        }
+        Check(cache.SaveTo(big_path.c_str(), PackEntry), "LruCache SaveTo multi chunk");
+    }
+    int64_t big_size = File::Size(big_path.c_str());
+    {
+        File file;
+        byte_t b = 0xFF;
+        Check(file.Open(big_path.c_str(), File::OF_READWRITE) && file.Write(big_size - 32, &b, 1) == 1, "corrupt last chunk");
+
+        StrCache cache(100000000);
+        Check(!cache.LoadFrom(big_path.c_str(), UnpackEntry), "LruCache rejects corrupt last chunk");
+        Check(cache.Size() == 0, "LruCache corrupt load rolled back");
+
+        Check(file.Truncate(big_size - 8), "truncate file");
+        Check(!cache.LoadFrom(big_path.c_str(), UnpackEntry) && cache.Size() == 0, "LruCache rejects truncated file");
+    }
+}
+
+//所有key的hash落在8个桶中，用于检查按key删除文件记录
+struct CollideHash
+{
+    inline uint32_t operator()(uint64_t key) const
+    {
+        return (uint32_t)(key % 8);
+    }
+};
+
+typedef LruCache<uint64_t, std::string, CollideHash> TierCache;
+
+//文件二级缓存往返：淘汰后读回；Delete只删除该key的记录；并发读写后内容一致
+static void TestFileTier(const std::string& dir)
+{
+    std::string tier_dir = dir + "/tier";
+    Directory::Remove(tier_dir.c_str());
+    Directory::Create_r(tier_dir.c_str());
+    {
+        TierCache cache(160);
+        Check(cache.EnableFileTier(tier_dir.c_str(), 1 << 20, PackEntry, UnpackEntry, 4096), "EnableFileTier");
+        for(uint64_t i = 0; i < 200; ++i)
+        {
+            cache.Add(i, ValueOf(i), 16);
+        }
+        Check(cache.Stats().spill_count > 0, "FileTier spill");
+
+        int bad = 0;
+        for(uint64_t i = 0; i < 200; ++i)
+        {
+            std::string value;
+            if(!cache.Get(i, value) || value != ValueOf(i))
+            {
+                ++bad;
+            }
+        }
+        Check(bad == 0, "FileTier read back");
+
+        //3和11的hash相同
+        for(uint64_t i = 200; i < 400; ++i)
+        {
+            cache.Add(i, ValueOf(i), 16);
+        }
+        cache.Delete(3);
+        std::string value;
+        Check(!cache.Get(3, value), "FileTier Delete");
+        Check(cache.Get(11, value) && value == ValueOf(11), "FileTier Delete keeps colliding key");
+
+        std::vector<uint64_t> keys;
+        for(uint64_t i = 0; i < 400; ++i)
+        {
+            keys.push_back(i);
+        }
+        std::vector<std::string> values;
+        std::vector<bool> found;
+        cache.MultiGet(keys, values, found);
+        bad = 0;
+        for(uint64_t i = 0; i < 400; ++i)
+        {
+            if(found[i] != (i != 3) || (found[i] && values[i] != ValueOf(i)))
+            {
+                ++bad;
+            }
+        }
+        Check(bad == 0, "FileTier MultiGet");
+    }
+
+    Directory::Remove(tier_dir.c_str());
+    Directory::Create_r(tier_dir.c_str());
+    {
+        ShardedStrCache cache(64 * 16, 4);
+        Check(cache.EnableFileTier(tier_dir.c_str(), 256 * 1024, PackEntry, UnpackEntry, 4096), "EnableFileTier sharded");
+
+        std::atomic<int> bad(0);
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t]() {
+                uint64_t seed = t * 2654435761U + 1;
+                for(int n = 0; n < 20000; ++n)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    uint64_t key = seed % 2000;
+                    std::string value;
+                    switch(seed >> 60)
+                    {
+                    case 0:
+                        cache.Delete(key);
+                        break;
+                    case 1:
+                    case 2:
+                        if(cache.GetOrLoad(key, value, [](const uint64_t& k, std::string& v, size_t& size) {
+                            v = ValueOf(k);
+                            size = 16;
+                            return true;
+                        }) && value != ValueOf(key))
+                        {
+                            ++bad;
+                        }
+                        break;
+                    default:
+                        if(seed & 1)
+                        {
+                            cache.Add(key, ValueOf(key), 16);
+                        }
+                        else if(cache.Get(key, value) && value != ValueOf(key))
+                        {
+                            ++bad;
+                        }
+                        break;
+                    }
+                }
+            });
+        }
+        for(size_t i = 0; i < threads.size(); ++i)
+        {
+            threads[i].join();
+        }
+        Check(bad.load() == 0, "FileTier concurrent values");
+
+        //没有并发写入时删除的key不能再读到
+        for(uint64_t i = 0; i < 2000; i += 2)
+        {
+            cache.Delete(i);
+        }
+        int resurrect = 0;
+        for(uint64_t i = 0; i < 2000; i += 2)
+        {
+            std::string value;
+            if(cache.Get(i, value))
+            {
+                ++resurrect;
+            }
+        }
+        Check(resurrect == 0, "FileTier Delete after concurrent use");
+    }
+    Directory::Remove(tier_dir.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    std::string dir = (argc > 1) ? argv[1] : "xfutil_stress_data";
+    int round = (argc > 2) ? atoi(argv[2]) : 20;
+
+    Directory::Remove(dir.c_str());
+    if(!Directory::Create_r(dir.c_str()))
+    {
+        printf("create %s failed\n", dir.c_str());
+        return 1;
+    }
+
+    TestRingQueue(200000);
+    TestRingQueueMove();
+    TestSpscRingQueue(1000000);
+    TestSpscRingQueueMove();
+    TestThreadPool(round);
+    TestClockCache(200000);
+    TestPriorityQueueMove();
+    TestTimerWheel();
+    TestExpireWithinTick();
+    TestSaveLoad(dir);
+    TestFileTier(dir);
+    TestFiber(dir, round);
+
+    Directory::Remove(dir.c_str());
+    printf("%s\n", (g_failed == 0) ? "all passed" : "some checks failed");
+    return (g_failed == 0) ? 0 : 1;
+}